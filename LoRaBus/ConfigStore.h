@@ -0,0 +1,157 @@
+/*
+  ConfigStore.h
+
+    Copyright (C) 2018-2022 Sfera Labs S.r.l. - All rights reserved.
+
+    For information, see:
+    http://www.sferalabs.cc/
+
+  This code is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+  See file LICENSE.txt for further informations on licensing terms.
+*/
+
+#ifndef ConfigStore_h
+#define ConfigStore_h
+
+#include <FlashStorage.h>
+
+#define CONFIG_MAGIC      0x4C42
+#define CONFIG_SLOTS      4
+#define CONFIG_DATA_SIZE  1008 // record of 1024 bytes, 4 flash rows
+
+struct ConfigRecord {
+  uint16_t magic;
+  uint16_t version;
+  uint16_t length;
+  uint16_t reserved;
+  uint32_t seq;
+  uint32_t crc;
+  byte data[CONFIG_DATA_SIZE];
+};
+
+// the slots are part of the sketch image: their size must not change
+// across versions, new fields take the room left in the record
+static_assert(sizeof(ConfigRecord) == 1024, "ConfigRecord must be 1024 bytes");
+
+FlashStorage(configSlot0, ConfigRecord);
+FlashStorage(configSlot1, ConfigRecord);
+FlashStorage(configSlot2, ConfigRecord);
+FlashStorage(configSlot3, ConfigRecord);
+
+/*
+  Stores the configuration in a record rotated over CONFIG_SLOTS flash
+  slots: each save goes to the slot following the last one written, with
+  a higher sequence number, so that a save interrupted by a power loss
+  leaves the previous record valid.
+  The record carries the version and the length of the data it was saved
+  with: fields are only ever appended, so a shorter record from a previous
+  version is loaded over the defaults of the new fields.
+*/
+class ConfigStore {
+  private:
+    static FlashStorageClass<ConfigRecord> *const _slots[CONFIG_SLOTS];
+    static int _last;
+
+    static uint32_t _crc(ConfigRecord *rec);
+
+  public:
+    static uint16_t version;
+    static uint32_t seq;
+
+    static uint32_t crc32(const void *data, int len, uint32_t crc);
+    static bool load(void *data, int len);
+    static bool save(const void *data, int len, uint16_t version);
+};
+
+FlashStorageClass<ConfigRecord> *const ConfigStore::_slots[CONFIG_SLOTS] =
+    {&configSlot0, &configSlot1, &configSlot2, &configSlot3};
+int ConfigStore::_last = -1;
+uint16_t ConfigStore::version = 0;
+uint32_t ConfigStore::seq = 0;
+
+/*
+  CRC-32 (IEEE 802.3), crc = 0 to start a new computation
+*/
+uint32_t ConfigStore::crc32(const void *data, int len, uint32_t crc) {
+  const byte *p = (const byte *) data;
+  crc = ~crc;
+  for (int i = 0; i < len; i++) {
+    crc ^= p[i];
+    for (int b = 0; b < 8; b++) {
+      crc = (crc >> 1) ^ (0xEDB88320ul & (0 - (crc & 1)));
+    }
+  }
+  return ~crc;
+}
+
+uint32_t ConfigStore::_crc(ConfigRecord *rec) {
+  uint32_t crc = crc32(rec, offsetof(ConfigRecord, crc), 0);
+  return crc32(rec->data, rec->length, crc);
+}
+
+/*
+  Loads the most recent valid record into data, copying at most len
+  bytes. Returns false if no valid record is found.
+*/
+bool ConfigStore::load(void *data, int len) {
+  // on the stack, only needed at startup and on save
+  ConfigRecord record;
+  int best = -1;
+  for (int i = 0; i < CONFIG_SLOTS; i++) {
+    _slots[i]->read(&record);
+    if (record.magic != CONFIG_MAGIC || record.length > CONFIG_DATA_SIZE
+        || _crc(&record) != record.crc) {
+      continue;
+    }
+    if (best < 0 || (int32_t) (record.seq - seq) > 0) {
+      best = i;
+      seq = record.seq;
+    }
+  }
+  _last = best;
+  if (best < 0) {
+    seq = 0;
+    return false;
+  }
+  _slots[best]->read(&record);
+  version = record.version;
+  memcpy(data, record.data, min((int) record.length, len));
+  return true;
+}
+
+/*
+  Saves len bytes of data as a new record. Returns false if data does not
+  fit the record or if the record read back from flash is not valid.
+*/
+bool ConfigStore::save(const void *data, int len, uint16_t version) {
+  if (len > CONFIG_DATA_SIZE) {
+    return false;
+  }
+  ConfigRecord record;
+  memset(&record, 0, sizeof(ConfigRecord));
+  record.magic = CONFIG_MAGIC;
+  record.version = version;
+  record.length = len;
+  record.seq = seq + 1;
+  memcpy(record.data, data, len);
+  record.crc = _crc(&record);
+  _last = (_last + 1) % CONFIG_SLOTS;
+  _slots[_last]->write(record);
+  // read back: a write that did not take leaves the previous record
+  uint32_t crc = record.crc;
+  _slots[_last]->read(&record);
+  if (record.magic != CONFIG_MAGIC || record.length > CONFIG_DATA_SIZE
+      || record.crc != crc || _crc(&record) != crc) {
+    return false;
+  }
+  seq = record.seq;
+  ConfigStore::version = version;
+  return true;
+}
+
+extern ConfigStore ConfigStore;
+
+#endif
@@ -0,0 +1,225 @@
+/*
+  Counters.h
+
+    Copyright (C) 2018-2022 Sfera Labs S.r.l. - All rights reserved.
+
+    For information, see:
+    http://www.sferalabs.cc/
+
+  This code is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+  See file LICENSE.txt for further informations on licensing terms.
+*/
+
+#ifndef Counters_h
+#define Counters_h
+
+#include <FlashStorage.h>
+#include "ConfigStore.h"
+#include "SerialConfig.h"
+
+#define COUNTERS_MAGIC        0x4C43
+#define COUNTERS_MAX_UNITS    MAX_SLAVES  // sets the journal record layout
+#define COUNTERS_SLOTS        4
+#define COUNTERS_SAVE_PERIOD  3600  // [s] min time between journal writes
+
+struct CountersEntry {
+  byte addr;
+  byte reserved;
+  word offset[6];
+  word last[6];
+};
+
+struct CountersRecord {
+  uint16_t magic;
+  uint16_t num;
+  uint32_t seq;
+  uint32_t crc;
+  CountersEntry entries[COUNTERS_MAX_UNITS];
+};
+
+// RAM [bytes] of the record and of the addresses index
+#define COUNTERS_RAM_SIZE (sizeof(CountersRecord) + 256)
+
+FlashStorage(countersSlot0, CountersRecord);
+FlashStorage(countersSlot1, CountersRecord);
+FlashStorage(countersSlot2, CountersRecord);
+FlashStorage(countersSlot3, CountersRecord);
+
+/*
+  Keeps the DI counters of the remote units continuous across resets of
+  the units and of the gateway. A counter lower than its last value, by
+  less than half of its range, means the unit restarted counting: the
+  last value is added to the counter's offset. A larger drop is taken as
+  the 16 bit roll over.
+  Offsets and last values are checkpointed to a journal rotated over
+  COUNTERS_SLOTS flash slots, at most once every COUNTERS_SAVE_PERIOD
+  and only if changed, and restored at startup, without the units no
+  longer in the configured remote units list.
+*/
+class Counters {
+  private:
+    static FlashStorageClass<CountersRecord> *const _slots[COUNTERS_SLOTS];
+    static CountersRecord _record;
+    static byte _index[256];
+    static int _last;
+    static bool _changed;
+    static unsigned long _saveTs;
+
+    static uint32_t _crc();
+    static bool _configured(byte addr);
+    static void _prune();
+    static CountersEntry *_entry(byte addr, bool add);
+
+  public:
+    static void restore();
+    static word update(byte addr, int input, word count);
+    static word value(byte addr, int input);
+    static void process();
+};
+
+FlashStorageClass<CountersRecord> *const Counters::_slots[COUNTERS_SLOTS] =
+    {&countersSlot0, &countersSlot1, &countersSlot2, &countersSlot3};
+CountersRecord Counters::_record;
+byte Counters::_index[256];
+int Counters::_last = -1;
+bool Counters::_changed = false;
+unsigned long Counters::_saveTs;
+
+uint32_t Counters::_crc() {
+  uint32_t crc = ConfigStore.crc32(&_record, offsetof(CountersRecord, crc), 0);
+  return ConfigStore.crc32(_record.entries, _record.num * sizeof(CountersEntry), crc);
+}
+
+/*
+  Loads the most recent valid journal record
+*/
+void Counters::restore() {
+  int best = -1;
+  uint32_t seq = 0;
+  for (int i = 0; i < COUNTERS_SLOTS; i++) {
+    _slots[i]->read(&_record);
+    if (_record.magic != COUNTERS_MAGIC || _record.num > COUNTERS_MAX_UNITS
+        || _crc() != _record.crc) {
+      continue;
+    }
+    if (best < 0 || (int32_t) (_record.seq - seq) > 0) {
+      best = i;
+      seq = _record.seq;
+    }
+  }
+  _last = best;
+  if (best >= 0) {
+    _slots[best]->read(&_record);
+  } else {
+    _record.num = 0;
+    _record.seq = 0;
+  }
+  _changed = false;
+  _prune();
+  _saveTs = millis();
+}
+
+/*
+  True if the unit is in the remote units list, or any unit can be
+  discovered
+*/
+bool Counters::_configured(byte addr) {
+  if (SerialConfig.slavesNum == 0) {
+    return true;
+  }
+  for (int i = 0; i < SerialConfig.slavesNum; i++) {
+    if (SerialConfig.slavesAddr[i] == addr) {
+      return true;
+    }
+  }
+  return false;
+}
+
+/*
+  Removes the entries of the units no longer configured, to be saved
+  with the next checkpoint, and rebuilds the addresses index
+*/
+void Counters::_prune() {
+  int num = 0;
+  for (int i = 0; i < _record.num; i++) {
+    if (_configured(_record.entries[i].addr)) {
+      if (num != i) {
+        _record.entries[num] = _record.entries[i];
+      }
+      num++;
+    }
+  }
+  if (num != _record.num) {
+    _record.num = num;
+    _changed = true;
+  }
+  memset(_index, 0, sizeof(_index));
+  for (int i = 0; i < _record.num; i++) {
+    _index[_record.entries[i].addr] = i + 1;
+  }
+}
+
+CountersEntry *Counters::_entry(byte addr, bool add) {
+  if (_index[addr] != 0) {
+    return &_record.entries[_index[addr] - 1];
+  }
+  if (!add || _record.num >= COUNTERS_MAX_UNITS) {
+    return NULL;
+  }
+  CountersEntry *e = &_record.entries[_record.num++];
+  memset(e, 0, sizeof(CountersEntry));
+  e->addr = addr;
+  _index[addr] = _record.num;
+  return e;
+}
+
+/*
+  Returns the continuous value of the counter of input (0-5) of the unit
+  given the count it last reported
+*/
+word Counters::update(byte addr, int input, word count) {
+  CountersEntry *e = _entry(addr, true);
+  if (e == NULL) {
+    return count;
+  }
+  if (count != e->last[input]) {
+    if (count < e->last[input] && e->last[input] - count < 0x8000) {
+      e->offset[input] += e->last[input];
+    }
+    e->last[input] = count;
+    _changed = true;
+  }
+  return e->last[input] + e->offset[input];
+}
+
+/*
+  Returns the last continuous value of the counter, before the unit
+  reports its state
+*/
+word Counters::value(byte addr, int input) {
+  CountersEntry *e = _entry(addr, false);
+  if (e == NULL) {
+    return 0;
+  }
+  return e->last[input] + e->offset[input];
+}
+
+void Counters::process() {
+  if (!_changed || millis() - _saveTs < COUNTERS_SAVE_PERIOD * 1000ul) {
+    return;
+  }
+  _record.magic = COUNTERS_MAGIC;
+  _record.seq++;
+  _record.crc = _crc();
+  _last = (_last + 1) % COUNTERS_SLOTS;
+  _slots[_last]->write(_record);
+  _changed = false;
+  _saveTs = millis();
+}
+
+extern Counters Counters;
+
+#endif
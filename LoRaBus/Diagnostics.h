@@ -0,0 +1,61 @@
+/*
+  Diagnostics.h
+
+    Copyright (C) 2018-2022 Sfera Labs S.r.l. - All rights reserved.
+
+    For information, see:
+    http://www.sferalabs.cc/
+
+  This code is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+  See file LICENSE.txt for further informations on licensing terms.
+*/
+
+#ifndef Diagnostics_h
+#define Diagnostics_h
+
+#define DIAG_MAX 12
+
+/*
+  Named diagnostic values, registered by the modules that keep them and
+  shown by the configuration console, so that the console does not
+  depend on those modules
+*/
+class Diagnostics {
+  private:
+    static const char *_names[DIAG_MAX];
+    static word (*_readers[DIAG_MAX])();
+
+  public:
+    static int num;
+
+    static void add(const char *name, word (*reader)());
+    static const char *name(int i);
+    static word read(int i);
+};
+
+const char *Diagnostics::_names[DIAG_MAX];
+word (*Diagnostics::_readers[DIAG_MAX])();
+int Diagnostics::num = 0;
+
+void Diagnostics::add(const char *name, word (*reader)()) {
+  if (num < DIAG_MAX) {
+    _names[num] = name;
+    _readers[num] = reader;
+    num++;
+  }
+}
+
+const char *Diagnostics::name(int i) {
+  return _names[i];
+}
+
+word Diagnostics::read(int i) {
+  return _readers[i]();
+}
+
+extern Diagnostics Diagnostics;
+
+#endif
@@ -0,0 +1,124 @@
+/*
+  DutyCycle.h
+
+    Copyright (C) 2018-2022 Sfera Labs S.r.l. - All rights reserved.
+
+    For information, see:
+    http://www.sferalabs.cc/
+
+  This code is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+  See file LICENSE.txt for further informations on licensing terms.
+*/
+
+#ifndef DutyCycle_h
+#define DutyCycle_h
+
+#define DC_BANDWIDTH    125000l
+#define DC_PREAMBLE     8
+#define DC_CMD_LEN      32   // estimated length of a command frame [bytes]
+#define DC_RESERVE      4    // 1/4 of the budget is reserved to high priority frames
+
+class DutyCycle {
+  private:
+    static unsigned long _budget;
+    static unsigned long _used;
+    static unsigned long _winMs;
+    static unsigned long _winStart;
+
+    static void _checkWindow();
+
+  public:
+    static byte sf;
+    // commands held by the caller, counted once per command
+    static word rejected;
+    static word deferred;
+    static word dropped;
+
+    static void setup(byte sf, uint16_t dcWin, uint16_t dc);
+    static unsigned long timeOnAir(byte sf, int payloadLen);
+    static bool admit(unsigned long toa, bool priority);
+    static unsigned long remaining();
+    static unsigned long windowLeft();
+};
+
+unsigned long DutyCycle::_budget;
+unsigned long DutyCycle::_used;
+unsigned long DutyCycle::_winMs;
+unsigned long DutyCycle::_winStart;
+byte DutyCycle::sf;
+word DutyCycle::rejected = 0;
+word DutyCycle::deferred = 0;
+word DutyCycle::dropped = 0;
+
+/*
+  dcWin in seconds, dc in 1/1000
+*/
+void DutyCycle::setup(byte sf, uint16_t dcWin, uint16_t dc) {
+  DutyCycle::sf = sf;
+  _winMs = dcWin * 1000ul;
+  _budget = dcWin * (unsigned long) dc;
+  _used = 0;
+  _winStart = millis();
+}
+
+/*
+  Returns the time-on-air [ms] of a packet with the specified payload
+  length, explicit header, CRC enabled and coding rate 4/5
+  (Semtech AN1200.13).
+*/
+unsigned long DutyCycle::timeOnAir(byte sf, int payloadLen) {
+  // symbol time in us
+  unsigned long tSym = (1ul << sf) * 1000000ul / DC_BANDWIDTH;
+  int de = (tSym >= 16000) ? 1 : 0;
+  long num = 8l * payloadLen - 4 * sf + 28 + 16;
+  long den = 4 * (sf - 2 * de);
+  long nPayload = 8;
+  if (num > 0) {
+    nPayload += ((num + den - 1) / den) * 5;
+  }
+  unsigned long tPreamble = (DC_PREAMBLE * 4 + 17) * tSym / 4;
+  return (tPreamble + nPayload * tSym + 999) / 1000;
+}
+
+void DutyCycle::_checkWindow() {
+  if (millis() - _winStart >= _winMs) {
+    _winStart += ((millis() - _winStart) / _winMs) * _winMs;
+    _used = 0;
+  }
+}
+
+/*
+  Accounts a frame of the specified time-on-air [ms] if it fits in the
+  remaining budget. Low priority frames cannot use the reserved part of
+  the budget, high priority frames are deferred once the whole budget is
+  used: frames are only sent when admitted, so that the LoRaNet duty
+  cycle limit is never hit.
+*/
+bool DutyCycle::admit(unsigned long toa, bool priority) {
+  _checkWindow();
+  if (!priority && _used + toa > _budget - _budget / DC_RESERVE) {
+    return false;
+  }
+  if (priority && _used + toa > _budget) {
+    return false;
+  }
+  _used += toa;
+  return true;
+}
+
+unsigned long DutyCycle::remaining() {
+  _checkWindow();
+  return _used >= _budget ? 0 : _budget - _used;
+}
+
+unsigned long DutyCycle::windowLeft() {
+  _checkWindow();
+  return _winMs - (millis() - _winStart);
+}
+
+extern DutyCycle DutyCycle;
+
+#endif
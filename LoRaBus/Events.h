@@ -0,0 +1,133 @@
+/*
+  Events.h
+
+    Copyright (C) 2018-2022 Sfera Labs S.r.l. - All rights reserved.
+
+    For information, see:
+    http://www.sferalabs.cc/
+
+  This code is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+  See file LICENSE.txt for further informations on licensing terms.
+*/
+
+#ifndef Events_h
+#define Events_h
+
+#define EVENTS_SIZE     64   // events held by the gateway
+#define EVENTS_WINDOW   8    // events readable with a single request
+#define EVENT_REGS      6    // registers per event
+
+struct Event {
+  byte unit;
+  byte input;
+  byte state;
+  word pulses;
+  unsigned long ts;
+};
+
+#define EVENTS_RAM_SIZE (EVENTS_SIZE * sizeof(Event))
+
+/*
+  Ring buffer of the digital inputs events of the remote units, drained
+  by the Modbus master: the oldest events are exposed in a register
+  window and removed when acknowledged. When full, new events are dropped
+  and counted.
+*/
+class Events {
+  private:
+    static Event _buffer[EVENTS_SIZE];
+    static int _head;
+    static int _count;
+
+  public:
+    static word dropped;
+
+    static void add(byte unit, byte input, byte state, word pulses, unsigned long ts);
+    static void remove(word num);
+    static bool read(word regAddr, word *value);
+};
+
+Event Events::_buffer[EVENTS_SIZE];
+int Events::_head = 0;
+int Events::_count = 0;
+word Events::dropped = 0;
+
+/*
+  ts in seconds, pulses is the counter increment since the previous
+  event of the same input
+*/
+void Events::add(byte unit, byte input, byte state, word pulses, unsigned long ts) {
+  if (_count >= EVENTS_SIZE) {
+    dropped++;
+    return;
+  }
+  Event *e = &_buffer[(_head + _count) % EVENTS_SIZE];
+  e->unit = unit;
+  e->input = input;
+  e->state = state;
+  e->pulses = pulses;
+  e->ts = ts;
+  _count++;
+}
+
+/*
+  Removes the num oldest events
+*/
+void Events::remove(word num) {
+  num = min(num, (word) _count);
+  _head = (_head + num) % EVENTS_SIZE;
+  _count -= num;
+}
+
+/*
+  Registers layout: 5501 = events in the buffer, 5502 = dropped events,
+  5511 + 6 * n = unit address, input, state, pulses, timestamp high and
+  low word of the n-th oldest event, 0 if not present
+*/
+bool Events::read(word regAddr, word *value) {
+  if (regAddr == 5501) {
+    *value = _count;
+    return true;
+  }
+  if (regAddr == 5502) {
+    *value = dropped;
+    return true;
+  }
+  if (regAddr < 5511 || regAddr >= 5511 + EVENTS_WINDOW * EVENT_REGS) {
+    return false;
+  }
+  int n = (regAddr - 5511) / EVENT_REGS;
+  if (n >= _count) {
+    *value = 0;
+    return true;
+  }
+  Event *e = &_buffer[(_head + n) % EVENTS_SIZE];
+  switch ((regAddr - 5511) % EVENT_REGS) {
+    case 0:
+      *value = e->unit;
+      break;
+    case 1:
+      *value = e->input;
+      break;
+    case 2:
+      *value = e->state;
+      break;
+    case 3:
+      *value = e->pulses;
+      break;
+    case 4:
+      *value = e->ts >> 16;
+      break;
+    default:
+      *value = e->ts & 0xFFFF;
+      break;
+  }
+  return true;
+}
+
+extern Events Events;
+
+#endif
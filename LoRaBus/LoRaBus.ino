@@ -18,17 +18,94 @@
 #include <LoRa.h>
 #include <IonoLoRaNet.h>
 #include "SerialConfig.h"
+#include "RegisterMap.h"
+#include "DutyCycle.h"
+#include "Profiler.h"
+#include "Reports.h"
+#include "Events.h"
+#include "Counters.h"
+#include "SiteClock.h"
+#include "LowPower.h"
 #include "Watchdog.h"
+#include "Diagnostics.h"
 
 #define DELAY  25
 
+// RAM [bytes] reserved to the remote units buffers of the gateway, out of
+// the 32 KB of the SAMD21, including the counters journal and the events
+#ifndef SLAVES_RAM_SIZE
+#define SLAVES_RAM_SIZE 20480
+#endif
+
+#ifndef MB_EX_SLAVE_DEVICE_FAILURE
+#define MB_EX_SLAVE_DEVICE_FAILURE 0x04
+#endif
+
+// Link margin [dB] required over the demodulation floor to recommend a spreading factor
+#define SF_MARGIN 10
+
+// Commands delivery: retries of unconfirmed commands with doubling delays
+#define CMD_RETRY_TIME  3000
+#define CMD_MAX_RETRIES 5
+#define CMD_UPLINK_DELAY 1000  // [ms] min time between a send and a re-send on update
+#define CMD_RETRY_SPAN  141000 // [ms] sum of the retry delays, max time commands are held
+
+#define CMD_AO      0x10
+#define CMD_RELAYS  0x0F
+
+#define UPDATE_NONE   0
+#define UPDATE_FIRST  1
+#define UPDATE_NEW    2
+#define CMD_IDLE    0
+#define CMD_PENDING 1
+#define CMD_FAILED  2
+
 #define ID_NUMBER_GW 0x21
 #define ID_NUMBER_SLAVE 0x22
 
+// Outputs state commanded to a remote unit and its delivery
+struct SlaveCommands {
+  byte relays;
+  byte relaysSet;
+  word ao;
+  byte pending;
+  byte status;
+  byte retries;
+  byte held;      // CMD_RELAYS, CMD_AO: already counted as held by the duty cycle
+  unsigned long firstTs;
+  unsigned long sendTs;
+  unsigned long nextTs;
+  word skipped;
+  word failed;
+  word resent;
+};
+
+// Link performance measured on a remote unit
+struct SlaveStats {
+  bool received;
+  unsigned long updateLo;  // bounds of the last state update's receive time
+  unsigned long updateHi;
+  word latency;
+  word latencyMax;
+  word updates;
+};
+
 IonoLoRaLocalSlave loRaSlave;
 IonoLoRaLocalMaster loRaMaster;
+int slavesMax;
 IonoLoRaRemoteSlave slavesBuffer[MAX_SLAVES];
 LoRaRemoteSlave *slavesRefsBuffer[MAX_SLAVES];
+IonoLoRaRemoteSlave *slavesByAddr[256];
+int slavesIndexed;
+word slavesImage[MAX_SLAVES][IMG_SIZE];
+SlaveCommands slavesCmds[MAX_SLAVES];
+SlaveStats slavesStats[MAX_SLAVES];
+
+static_assert(sizeof(slavesBuffer) + sizeof(slavesRefsBuffer) + sizeof(slavesByAddr)
+    + sizeof(slavesImage) + sizeof(slavesCmds) + sizeof(slavesStats)
+    + COUNTERS_RAM_SIZE + EVENTS_RAM_SIZE <= SLAVES_RAM_SIZE,
+    "MAX_SLAVES exceeds the RAM reserved to the remote units");
+int slavesCmdIdx;
 bool initialized;
 
 void setup() {
@@ -44,29 +121,61 @@ void loop() {
     initialized = initialize();
     return;
   }
+  PROFILE_START();
   if (SerialConfig.isGateway) {
     loRaMaster.process();
+    checkSlavesIndex();
+    PROFILE_STAGE(PRF_LORA);
+    if (!SerialConfig.isAvailable) {
+      // serve any request received while the radio was busy before
+      // running the background work
+      IonoModbusRtuSlave.process();
+      PROFILE_STAGE(PRF_MODBUS);
+    }
+    refreshUpdatedImages();
+    PROFILE_STAGE(PRF_IMAGE);
+    processCommands();
+    PROFILE_STAGE(PRF_CMDS);
+    Counters.process();
+    PROFILE_STAGE(PRF_COUNTERS);
     if (SerialConfig.isAvailable) {
       SerialConfig.process();
       if (!SerialConfig.isAvailable) {
         startModbus();
       }
+      PROFILE_STAGE(PRF_CONFIG);
       Iono.process();
+      PROFILE_STAGE(PRF_IONO);
     } else {
       IonoModbusRtuSlave.process();
+      PROFILE_STAGE(PRF_MODBUS);
     }
   } else {
-    loRaSlave.process();
+    Reports.process();
+    if (LowPower.isAwake()) {
+      loRaSlave.process();
+    } else {
+      // the inputs are sampled while the radio sleeps
+      Iono.process();
+    }
+    PROFILE_STAGE(PRF_LORA);
     if (SerialConfig.isAvailable) {
       SerialConfig.process();
+      PROFILE_STAGE(PRF_CONFIG);
     }
   }
   Watchdog.clear();
+  PROFILE_END();
+  if (!SerialConfig.isGateway) {
+    // may idle the MCU until the next interrupt
+    LowPower.process();
+  }
 }
 
 bool initialize() {
   if (SerialConfig.frequency > 0l) {
-    if (!LoRa.begin(SerialConfig.frequency * 1000l)) {
+    uint32_t channel = SerialConfig.channel();
+    if (!LoRa.begin(channel * 1000l)) {
       __DEBUGprintln("LoRaBus: initialization failed");
       delay(200);
       return false;
@@ -76,38 +185,70 @@ bool initialize() {
     LoRa.setSpreadingFactor(SerialConfig.sf);
     LoRa.setTxPower(SerialConfig.txPower);
     LoRaNet.init(SerialConfig.siteId, 3, SerialConfig.pwd);
-    LoRaNet.setDutyCycle(SerialConfig.dcWin, SerialConfig.dc);
+    // the duty cycle is capped to the limit of the channel's sub-band
+    uint16_t dc = min(SerialConfig.dc, SerialConfig.subBandDc(channel));
+    LoRaNet.setDutyCycle(SerialConfig.dcWin, dc);
+    DutyCycle.setup(SerialConfig.sf, SerialConfig.dcWin, dc);
 
     if (SerialConfig.isGateway) {
-      for (int i = 0; i < MAX_SLAVES; i++) {
+      slavesMax = SerialConfig.slavesNum > 0 ? SerialConfig.slavesNum : MAX_SLAVES;
+      for (int i = 0; i < slavesMax; i++) {
         slavesRefsBuffer[i] = &slavesBuffer[i];
       }
+      Counters.restore();
+      clearSlavesIndex();
+      slavesCmdIdx = 0;
+      for (int i = 0; i < slavesMax; i++) {
+        slavesCmds[i].relaysSet = 0;
+        slavesCmds[i].ao = 0xFFFF;
+        slavesCmds[i].pending = 0;
+        slavesCmds[i].status = CMD_IDLE;
+        slavesCmds[i].retries = 0;
+        slavesCmds[i].held = 0;
+        slavesCmds[i].skipped = 0;
+        slavesCmds[i].failed = 0;
+        slavesCmds[i].resent = 0;
+        slavesStats[i].received = false;
+        slavesStats[i].latency = 0xFFFF;
+        slavesStats[i].latencyMax = 0;
+        slavesStats[i].updates = 0;
+      }
 
       if (SerialConfig.slavesNum > 0) {
         for (int i = 0; i < SerialConfig.slavesNum; i++) {
           slavesRefsBuffer[i]->setAddr(SerialConfig.slavesAddr[i]);
         }
         loRaMaster.setSlaves(slavesRefsBuffer, SerialConfig.slavesNum);
+        indexSlaves();
       } else {
-        loRaMaster.enableDiscovery(slavesRefsBuffer, MAX_SLAVES);
+        loRaMaster.enableDiscovery(slavesRefsBuffer, slavesMax);
       }
 
     } else {
       loRaSlave.setAddr(SerialConfig.address);
 
-      Iono.subscribeDigital(DO1, 0, &IonoLoRaLocalSlave::subscribeCallback);
-      Iono.subscribeDigital(DO2, 0, &IonoLoRaLocalSlave::subscribeCallback);
-      Iono.subscribeDigital(DO3, 0, &IonoLoRaLocalSlave::subscribeCallback);
-      Iono.subscribeDigital(DO4, 0, &IonoLoRaLocalSlave::subscribeCallback);
+      Iono.subscribeDigital(DO1, 0, &Reports::outputCallback);
+      Iono.subscribeDigital(DO2, 0, &Reports::outputCallback);
+      Iono.subscribeDigital(DO3, 0, &Reports::outputCallback);
+      Iono.subscribeDigital(DO4, 0, &Reports::outputCallback);
+
+      Iono.subscribeAnalog(AO1, 0, 0, &Reports::outputCallback);
 
-      Iono.subscribeAnalog(AO1, 0, 0, &IonoLoRaLocalSlave::subscribeCallback);
+      subscribeMultimode(SerialConfig.modes[0], DI1, AV1, AI1, SerialConfig.inDb[0]);
+      subscribeMultimode(SerialConfig.modes[1], DI2, AV2, AI2, SerialConfig.inDb[1]);
+      subscribeMultimode(SerialConfig.modes[2], DI3, AV3, AI3, SerialConfig.inDb[2]);
+      subscribeMultimode(SerialConfig.modes[3], DI4, AV4, AI4, SerialConfig.inDb[3]);
+      subscribeMultimode(SerialConfig.modes[4], DI5, 0, 0, 0);
+      subscribeMultimode(SerialConfig.modes[5], DI6, 0, 0, 0);
 
-      subscribeMultimode(SerialConfig.modes[0], DI1, AV1, AI1);
-      subscribeMultimode(SerialConfig.modes[1], DI2, AV2, AI2);
-      subscribeMultimode(SerialConfig.modes[2], DI3, AV3, AI3);
-      subscribeMultimode(SerialConfig.modes[3], DI4, AV4, AI4);
-      subscribeMultimode(SerialConfig.modes[4], DI5, 0, 0);
-      subscribeMultimode(SerialConfig.modes[5], DI6, 0, 0);
+      // in low-power mode the heartbeat opens the receive windows
+      uint16_t hbPeriod = SerialConfig.hbPeriod;
+      if (SerialConfig.rxPeriod > 0 && (hbPeriod == 0 || hbPeriod > SerialConfig.rxPeriod)) {
+        hbPeriod = SerialConfig.rxPeriod;
+      }
+      unsigned long toa = DutyCycle.timeOnAir(SerialConfig.sf, DC_CMD_LEN);
+      Reports.setup(SerialConfig.aggrDelay, hbPeriod, SerialConfig.address, toa);
+      LowPower.setup(SerialConfig.rxPeriod > 0, SerialConfig.rxWindow, toa);
 
       loRaSlave.setUpdatesInterval(DI1, SerialConfig.inItvl[0]);
       loRaSlave.setUpdatesInterval(DI2, SerialConfig.inItvl[1]);
@@ -116,6 +257,7 @@ bool initialize() {
       loRaSlave.setUpdatesInterval(DI5, SerialConfig.inItvl[4]);
       loRaSlave.setUpdatesInterval(DI6, SerialConfig.inItvl[5]);
     }
+    addDiagnostics();
     return true;
   }
 
@@ -127,6 +269,7 @@ bool initialize() {
   }
 
   Watchdog.setup();
+  return true;
 }
 
 void startModbus() {
@@ -149,16 +292,81 @@ void startModbus() {
   IonoModbusRtuSlave.setCustomHandler(&onModbusRequest);
 }
 
-void subscribeMultimode(char mode, uint8_t dix, uint8_t avx, uint8_t aix) {
+word wdtNearDiag() {
+  return Watchdog.near;
+}
+
+word dcRejectedDiag() {
+  return DutyCycle.rejected;
+}
+
+word dcDeferredDiag() {
+  return DutyCycle.deferred;
+}
+
+word dcDroppedDiag() {
+  return DutyCycle.dropped;
+}
+
+word reportsSentDiag() {
+  return Reports.sent;
+}
+
+word reportsDeferredDiag() {
+  return Reports.deferred;
+}
+
+word reportsHeldDiag() {
+  return Reports.held;
+}
+
+word reportsDelayDiag() {
+  return Reports.delayMax;
+}
+
+word rxRatioDiag() {
+  return LowPower.rxRatio() * 100 + 0.5;
+}
+
+word currentDiag() {
+  return min(LowPower.current() * 1000 + 0.5, 65535.0);
+}
+
+/*
+  Registers the values shown by the console's diagnostics
+*/
+void addDiagnostics() {
+  Diagnostics.add("Watchdog clears close to timeout", &wdtNearDiag);
+  if (SerialConfig.isGateway) {
+    Diagnostics.add("AO1 commands held for duty cycle", &dcRejectedDiag);
+    Diagnostics.add("Relay commands held for duty cycle", &dcDeferredDiag);
+    Diagnostics.add("Commands dropped for duty cycle", &dcDroppedDiag);
+  } else {
+    Diagnostics.add("Reports sent", &reportsSentDiag);
+    Diagnostics.add("Reports deferred for busy channel", &reportsDeferredDiag);
+    Diagnostics.add("Reports held for duty cycle", &reportsHeldDiag);
+    Diagnostics.add("Max report delay [ms]", &reportsDelayDiag);
+    Diagnostics.add("Radio receiving [%]", &rxRatioDiag);
+    Diagnostics.add("Estimated mean current (MCU and radio) [uA]", &currentDiag);
+  }
+}
+
+/*
+  deadband in mV for voltage inputs, uA for current inputs
+*/
+void subscribeMultimode(char mode, uint8_t dix, uint8_t avx, uint8_t aix, uint16_t deadband) {
   switch (mode) {
     case 'D':
-      Iono.subscribeDigital(dix, DELAY, &IonoLoRaLocalSlave::subscribeCallback);
+      Iono.subscribeDigital(dix, DELAY, &Reports::subscribeCallback);
       break;
     case 'V':
-      Iono.subscribeAnalog(avx, DELAY, 0.1, &IonoLoRaLocalSlave::subscribeCallback);
+      // half the deadband: values are quantized to the deadband
+      Iono.subscribeAnalog(avx, DELAY, 0, &Reports::subscribeCallback);
+      Reports.setStep(avx, deadband / 1000.0);
       break;
     case 'I':
-      Iono.subscribeAnalog(aix, DELAY, 0.1, &IonoLoRaLocalSlave::subscribeCallback);
+      Iono.subscribeAnalog(aix, DELAY, 0, &Reports::subscribeCallback);
+      Reports.setStep(aix, deadband / 1000.0);
       break;
     default:
       break;
@@ -196,183 +404,714 @@ byte onModbusRequest(byte unitAddr, byte function, word regAddr, word qty, byte
       ModbusRtuSlave.responseAddRegister(ID_NUMBER_GW);
       return MB_RESP_OK;
     }
+    if (function == MB_FC_READ_INPUT_REGISTER && regAddr == 5004 && qty == 1) {
+      ModbusRtuSlave.responseAddRegister(siteSafeSf());
+      return MB_RESP_OK;
+    }
+    if (function == MB_FC_READ_INPUT_REGISTER && regAddr >= 5201 && regAddr <= 5205) {
+      if (regAddr + qty > 5206) {
+        return MB_EX_ILLEGAL_DATA_ADDRESS;
+      }
+      for (int i = regAddr; i < regAddr + qty; i++) {
+        switch (i) {
+          case 5201:
+            ModbusRtuSlave.responseAddRegister(min(DutyCycle.remaining(), 0xFFFFul));
+            break;
+          case 5202:
+            ModbusRtuSlave.responseAddRegister((DutyCycle.windowLeft() + 999) / 1000);
+            break;
+          case 5203:
+            ModbusRtuSlave.responseAddRegister(DutyCycle.rejected);
+            break;
+          case 5204:
+            ModbusRtuSlave.responseAddRegister(DutyCycle.deferred);
+            break;
+          case 5205:
+            ModbusRtuSlave.responseAddRegister(DutyCycle.dropped);
+            break;
+        }
+      }
+      return MB_RESP_OK;
+    }
+    if (function == MB_FC_READ_INPUT_REGISTER && regAddr == 5300 && qty == 1) {
+      ModbusRtuSlave.responseAddRegister(Watchdog.near);
+      return MB_RESP_OK;
+    }
+#ifdef PROFILER
+    if (function == MB_FC_READ_INPUT_REGISTER && regAddr > 5300 && regAddr < 5400) {
+      word value;
+      for (int i = regAddr; i < regAddr + qty; i++) {
+        if (!Profiler.read(i, &value)) {
+          return MB_EX_ILLEGAL_DATA_ADDRESS;
+        }
+      }
+      for (int i = regAddr; i < regAddr + qty; i++) {
+        Profiler.read(i, &value);
+        ModbusRtuSlave.responseAddRegister(value);
+      }
+      return MB_RESP_OK;
+    }
+#endif
+    if (function == MB_FC_READ_INPUT_REGISTER && regAddr >= 5501 && regAddr < 5600) {
+      word value;
+      for (int i = regAddr; i < regAddr + qty; i++) {
+        if (!Events.read(i, &value)) {
+          return MB_EX_ILLEGAL_DATA_ADDRESS;
+        }
+      }
+      for (int i = regAddr; i < regAddr + qty; i++) {
+        Events.read(i, &value);
+        ModbusRtuSlave.responseAddRegister(value);
+      }
+      return MB_RESP_OK;
+    }
+    if (function == MB_FC_READ_HOLDING_REGISTERS && regAddr >= 5601 && regAddr <= 5603) {
+      if (regAddr + qty > 5604) {
+        return MB_EX_ILLEGAL_DATA_ADDRESS;
+      }
+      uint32_t time = SiteClock.now();
+      for (int i = regAddr; i < regAddr + qty; i++) {
+        switch (i) {
+          case 5601:
+            ModbusRtuSlave.responseAddRegister(time >> 16);
+            break;
+          case 5602:
+            ModbusRtuSlave.responseAddRegister(time & 0xFFFF);
+            break;
+          case 5603:
+            ModbusRtuSlave.responseAddRegister((word) SiteClock.drift);
+            break;
+        }
+      }
+      return MB_RESP_OK;
+    }
+    if (function == MB_FC_WRITE_MULTIPLE_REGISTERS && regAddr == 5601) {
+      if (qty != 2) {
+        return MB_EX_ILLEGAL_DATA_ADDRESS;
+      }
+      SiteClock.set(((uint32_t) ModbusRtuSlave.getDataRegister(function, data, 0) << 16)
+          | ModbusRtuSlave.getDataRegister(function, data, 1));
+      return MB_RESP_OK;
+    }
+    if (function == MB_FC_WRITE_SINGLE_REGISTER && regAddr == 5503) {
+      // acknowledge the oldest events
+      Events.remove(ModbusRtuSlave.getDataRegister(function, data, 0));
+      return MB_RESP_OK;
+    }
     return MB_RESP_PASS;
   }
+  bool isGroup = unitAddr == 0 || SerialConfig.groupIndex(unitAddr) >= 0;
   IonoLoRaRemoteSlave *slave = NULL;
-  for (int i = 0; i < MAX_SLAVES; i++) {
-    if (slavesRefsBuffer[i]->getAddr() == unitAddr) {
-      slave = (IonoLoRaRemoteSlave*) slavesRefsBuffer[i];
-      break;
+  if (!isGroup) {
+    slave = findSlave(unitAddr);
+    if (slave == NULL) {
+      return MB_RESP_IGNORE;
     }
   }
-  if (slave == NULL) {
-    return MB_RESP_IGNORE;
-  }
 
+  const RegisterRange *reg;
   switch (function) {
     case MB_FC_READ_COILS:
-      if (checkAddrRange(regAddr, qty, 1, 4)) {
-        for (int i = regAddr; i < regAddr + qty; i++) {
-          ModbusRtuSlave.responseAddBit(slave->read(indexToDO(i)) == HIGH);
-        }
-        return MB_RESP_OK;
-      }
-      return MB_EX_ILLEGAL_DATA_ADDRESS;
-
     case MB_FC_READ_DISCRETE_INPUTS:
-      if (checkAddrRange(regAddr, qty, 101, 106)) {
-        for (int i = regAddr - 100; i < regAddr - 100 + qty; i++) {
-          ModbusRtuSlave.responseAddBit(slave->read(indexToDI(i)) == HIGH);
-        }
-        return MB_RESP_OK;
+    case MB_FC_READ_HOLDING_REGISTERS:
+    case MB_FC_READ_INPUT_REGISTER:
+      if (isGroup) {
+        return groupResponse(unitAddr, MB_EX_ILLEGAL_FUNCTION);
       }
-      return MB_EX_ILLEGAL_DATA_ADDRESS;
+      reg = RegisterMap.find(function, regAddr, qty);
+      break;
+    case MB_FC_WRITE_MULTIPLE_COILS:
+    case MB_FC_WRITE_MULTIPLE_REGISTERS:
+      reg = RegisterMap.find(function, regAddr, qty);
+      break;
+    case MB_FC_WRITE_SINGLE_COIL:
+    case MB_FC_WRITE_SINGLE_REGISTER:
+      reg = RegisterMap.find(function, regAddr, 1);
+      break;
+    default:
+      return isGroup ? groupResponse(unitAddr, MB_EX_ILLEGAL_FUNCTION) : MB_EX_ILLEGAL_FUNCTION;
+  }
+  if (reg == NULL) {
+    return isGroup ? groupResponse(unitAddr, MB_EX_ILLEGAL_DATA_ADDRESS) : MB_EX_ILLEGAL_DATA_ADDRESS;
+  }
 
-    case MB_FC_READ_HOLDING_REGISTERS:
-      if (regAddr == 601 && qty == 1) {
-        ModbusRtuSlave.responseAddRegister(analogToRegister(slave->read(AO1)));
-        return MB_RESP_OK;
+  if (isGroup) {
+    // broadcast (no response) or group write, queued for each member
+    if (slavesIndexed < slavesMax) {
+      indexSlaves();
+    }
+    int g = SerialConfig.groupIndex(unitAddr);
+    byte res = MB_RESP_OK;
+    for (int i = 0; i < slavesIndexed && res == MB_RESP_OK; i++) {
+      if (unitAddr == 0 || SerialConfig.inGroup(g, slavesBuffer[i].getAddr())) {
+        res = writeRegisters(&slavesBuffer[i], reg, function, regAddr, qty, data);
       }
-      return MB_EX_ILLEGAL_DATA_ADDRESS;
+    }
+    return groupResponse(unitAddr, res);
+  }
 
-    case MB_FC_READ_INPUT_REGISTER:
-      if (checkAddrRange(regAddr, qty, 201, 204)) {
-        for (int i = regAddr - 200; i < regAddr - 200 + qty; i++) {
-          ModbusRtuSlave.responseAddRegister(analogToRegister(slave->read(indexToAV(i))));
-        }
-        return MB_RESP_OK;
+  int idx = regAddr - reg->first + 1;
+  int slaveIdx = slave - slavesBuffer;
+  word *image = slavesImage[slaveIdx];
+  // an update received earlier in this loop is served right away. One
+  // received less than 1 second after the previous one may not be
+  // detected yet: while possible, registers are read from the state.
+  refreshIfUpdated(slaveIdx);
+  bool recent = slavesStats[slaveIdx].received
+      && millis() - slavesStats[slaveIdx].updateHi < 1000;
+  switch (function) {
+    case MB_FC_READ_COILS:
+    case MB_FC_READ_DISCRETE_INPUTS:
+      if (isStale(slave)) {
+        return MB_EX_SLAVE_DEVICE_FAILURE;
       }
-      if (checkAddrRange(regAddr, qty, 301, 304)) {
-        for (int i = regAddr - 300; i < regAddr - 300 + qty; i++) {
-          ModbusRtuSlave.responseAddRegister(analogToRegister(slave->read(indexToAI(i))));
-        }
-        return MB_RESP_OK;
+      image += reg->offset + idx - 1;
+      for (int i = 0; i < qty; i++) {
+        ModbusRtuSlave.responseAddBit(recent ? readRegister(slave, reg, idx + i) != 0 : image[i] != 0);
       }
-      if (checkAddrRange(regAddr, qty, 1001, 1006)) {
-        for (int i = regAddr - 1000; i < regAddr - 1000 + qty; i++) {
-          ModbusRtuSlave.responseAddRegister(slave->diCount(indexToDI(i)));
+      return MB_RESP_OK;
+
+    case MB_FC_READ_HOLDING_REGISTERS:
+    case MB_FC_READ_INPUT_REGISTER:
+      if (reg->offset == IMG_NONE) {
+        for (int i = idx; i < idx + qty; i++) {
+          ModbusRtuSlave.responseAddRegister(readRegister(slave, reg, i));
         }
         return MB_RESP_OK;
       }
-      if (regAddr == 5001 && qty == 1) {
-        ModbusRtuSlave.responseAddRegister(slave->loraRssi());
-        return MB_RESP_OK;
-      }
-      if (regAddr == 5002 && qty == 1) {
-        ModbusRtuSlave.responseAddRegister(slave->loraSnr() * 1000);
-        return MB_RESP_OK;
-      }
-      if (regAddr == 5101 && qty == 1) {
-        ModbusRtuSlave.responseAddRegister(slave->stateAge());
-        return MB_RESP_OK;
+      if (isStale(slave)) {
+        return MB_EX_SLAVE_DEVICE_FAILURE;
       }
-      if (regAddr == 99 && qty == 1) {
-        ModbusRtuSlave.responseAddRegister(ID_NUMBER_SLAVE);
-        return MB_RESP_OK;
+      image += reg->offset + idx - 1;
+      for (int i = 0; i < qty; i++) {
+        ModbusRtuSlave.responseAddRegister(recent ? readRegister(slave, reg, idx + i) : image[i]);
       }
-      return MB_EX_ILLEGAL_DATA_ADDRESS;
+      return MB_RESP_OK;
 
+    default:
+      return writeRegisters(slave, reg, function, regAddr, qty, data);
+  }
+}
+
+byte writeRegisters(IonoLoRaRemoteSlave *slave, const RegisterRange *reg,
+    byte function, word regAddr, word qty, byte *data) {
+  int idx = regAddr - reg->first + 1;
+  switch (function) {
     case MB_FC_WRITE_SINGLE_COIL:
-      if (regAddr >= 1 && regAddr <= 4) {
-        bool on = ModbusRtuSlave.getDataCoil(function, data, 0);
-        slave->write(indexToDO(regAddr), on ? HIGH : LOW);
-        return MB_RESP_OK;
+      writeRelays(slave, idx, 1, ModbusRtuSlave.getDataCoil(function, data, 0) ? 1 : 0);
+      return MB_RESP_OK;
+
+    case MB_FC_WRITE_SINGLE_REGISTER: {
+      word value = ModbusRtuSlave.getDataRegister(function, data, 0);
+      if (value > 10000) {
+        return MB_EX_ILLEGAL_DATA_VALUE;
       }
-      return MB_EX_ILLEGAL_DATA_ADDRESS;
+      writeAo(slave, value);
+      return MB_RESP_OK;
+    }
 
-    case MB_FC_WRITE_SINGLE_REGISTER:
-      if (regAddr == 601) {
-        word value = ModbusRtuSlave.getDataRegister(function, data, 0);
-        if (value < 0 || value > 10000) {
-          return MB_EX_ILLEGAL_DATA_VALUE;
+    case MB_FC_WRITE_MULTIPLE_COILS: {
+      byte states = 0;
+      for (int i = 0; i < qty; i++) {
+        if (ModbusRtuSlave.getDataCoil(function, data, i)) {
+          states |= 1 << i;
         }
-        slave->write(AO1, value / 1000.0);
-        return MB_RESP_OK;
       }
-      return MB_EX_ILLEGAL_DATA_ADDRESS;
+      writeRelays(slave, idx, qty, states);
+      return MB_RESP_OK;
+    }
 
-    case MB_FC_WRITE_MULTIPLE_COILS:
-      if (checkAddrRange(regAddr, qty, 1, 4)) {
-        for (int i = regAddr; i < regAddr + qty; i++) {
-          bool on = ModbusRtuSlave.getDataCoil(function, data, i - regAddr);
-          slave->write(indexToDO(i), on ? HIGH : LOW);
+    case MB_FC_WRITE_MULTIPLE_REGISTERS:
+      for (int i = 0; i < qty; i++) {
+        if (ModbusRtuSlave.getDataRegister(function, data, i) > 10000) {
+          return MB_EX_ILLEGAL_DATA_VALUE;
         }
-        return MB_RESP_OK;
       }
-      return MB_EX_ILLEGAL_DATA_ADDRESS;
+      // AO1 is the only writable register
+      writeAo(slave, ModbusRtuSlave.getDataRegister(function, data, 0));
+      return MB_RESP_OK;
 
     default:
       return MB_EX_ILLEGAL_FUNCTION;
   }
 }
 
-bool checkAddrRange(word regAddr, word qty, word min, word max) {
-  return regAddr >= min && regAddr <= max && regAddr + qty <= max + 1;
+/*
+  Response to a broadcast or group request, exceptions included: only
+  one gateway of a multi-gateway site responds to a group, none to a
+  broadcast
+*/
+byte groupResponse(byte unitAddr, byte res) {
+  return (unitAddr == 0 || !SerialConfig.isGroupResponder()) ? MB_RESP_IGNORE : res;
+}
+
+IonoLoRaRemoteSlave *findSlave(byte unitAddr) {
+  IonoLoRaRemoteSlave *slave = slavesByAddr[unitAddr];
+  if (slave != NULL && slave->getAddr() != unitAddr) {
+    // slave re-addressed, rebuild the index
+    clearSlavesIndex();
+    slave = NULL;
+  }
+  if (slave == NULL) {
+    if (slavesIndexed >= slavesMax || !indexSlaves()) {
+      return NULL;
+    }
+    slave = slavesByAddr[unitAddr];
+  }
+  return slave;
+}
+
+word readRegister(IonoLoRaRemoteSlave *slave, const RegisterRange *reg, int idx) {
+  switch (reg->type) {
+    case REG_DO:
+      return slave->read(indexToDO(idx)) == HIGH;
+    case REG_DI:
+      return slave->read(indexToDI(idx)) == HIGH;
+    case REG_AV:
+      return analogToRegister(slave->read(indexToAV(idx)), reg->scale);
+    case REG_AI:
+      return analogToRegister(slave->read(indexToAI(idx)), reg->scale);
+    case REG_AO:
+      return analogToRegister(slave->read(AO1), reg->scale);
+    case REG_DI_COUNT:
+      if (slave->stateAge() == 0xFFFF) {
+        return Counters.value(slave->getAddr(), idx - 1);
+      }
+      return Counters.update(slave->getAddr(), idx - 1, slave->diCount(indexToDI(idx)));
+    case REG_RSSI:
+      return slave->loraRssi();
+    case REG_SNR:
+      return slave->loraSnr() * reg->scale;
+    case REG_SF:
+      return safeSf(slave);
+    case REG_AGE:
+      return slave->stateAge();
+    case REG_SKIPPED_WRITES:
+      return slavesCmds[slave - slavesBuffer].skipped;
+    case REG_LATENCY:
+      return slavesStats[slave - slavesBuffer].latency;
+    case REG_LATENCY_MAX:
+      return slavesStats[slave - slavesBuffer].latencyMax;
+    case REG_UPDATES:
+      return slavesStats[slave - slavesBuffer].updates;
+    case REG_UPDATE_TIME: {
+      if (slave->stateAge() == 0xFFFF) {
+        return 0;
+      }
+      uint32_t time = SiteClock.now() - slave->stateAge();
+      return idx == 1 ? time >> 16 : time & 0xFFFF;
+    }
+    case REG_CMD:
+      switch (idx) {
+        case 1:
+          return slavesCmds[slave - slavesBuffer].status;
+        case 2:
+          return slavesCmds[slave - slavesBuffer].pending;
+        case 3:
+          return slavesCmds[slave - slavesBuffer].retries;
+        case 4:
+          return slavesCmds[slave - slavesBuffer].failed;
+        default:
+          return slavesCmds[slave - slavesBuffer].resent;
+      }
+    case REG_ID:
+      return ID_NUMBER_SLAVE;
+    default:
+      return 0;
+  }
+}
+
+/*
+  Queues the states of num relays starting from DO<first>, one bit each
+  in states, for delivery to the remote unit. A new write to a relay
+  replaces its pending state. Relays already in the requested state, both
+  as last commanded and as last reported by the unit, are not sent again.
+*/
+void writeRelays(IonoLoRaRemoteSlave *slave, int first, int num, byte states) {
+  int idx = slave - slavesBuffer;
+  SlaveCommands *cmds = &slavesCmds[idx];
+  bool queued = false;
+  for (int i = 0; i < num; i++) {
+    byte bit = 1 << (first + i - 1);
+    bool on = (states & (1 << i)) != 0;
+    if ((cmds->relaysSet & bit) && ((cmds->relays & bit) != 0) == on
+        && ((cmds->pending & bit) || (slavesImage[idx][IMG_DO + first + i - 1] != 0) == on)) {
+      cmds->skipped++;
+      continue;
+    }
+    cmds->relaysSet |= bit;
+    if (on) {
+      cmds->relays |= bit;
+    } else {
+      cmds->relays &= ~bit;
+    }
+    cmds->pending |= bit;
+    queued = true;
+  }
+  if (queued) {
+    queueCommands(idx);
+  }
 }
 
-word analogToRegister(float val) {
+/*
+  Queues the AO1 value for delivery to the remote unit, unless already set
+*/
+void writeAo(IonoLoRaRemoteSlave *slave, word value) {
+  int idx = slave - slavesBuffer;
+  SlaveCommands *cmds = &slavesCmds[idx];
+  if (cmds->ao == value && ((cmds->pending & CMD_AO) || slavesImage[idx][IMG_AO] == value)) {
+    cmds->skipped++;
+    return;
+  }
+  cmds->ao = value;
+  cmds->pending |= CMD_AO;
+  queueCommands(idx);
+}
+
+void queueCommands(int idx) {
+  SlaveCommands *cmds = &slavesCmds[idx];
+  cmds->status = CMD_PENDING;
+  cmds->retries = 0;
+  cmds->held = 0;
+  cmds->firstTs = millis();
+  cmds->nextTs = cmds->firstTs;
+}
+
+/*
+  Sends the pending commands of one remote unit per call, relays first.
+  Commands are re-sent with doubling delays until a state update confirms
+  them, and marked as failed after CMD_MAX_RETRIES retries. AO1, having
+  lower priority, waits while the duty cycle budget left is reserved to
+  relays. Relays wait while the whole budget is used, and are dropped if
+  still waiting after CMD_RETRY_SPAN.
+*/
+void processCommands() {
+  for (int n = 0; n < slavesIndexed; n++) {
+    if (slavesCmdIdx >= slavesIndexed) {
+      slavesCmdIdx = 0;
+    }
+    int idx = slavesCmdIdx++;
+    SlaveCommands *cmds = &slavesCmds[idx];
+    if (cmds->status != CMD_PENDING || (long) (millis() - cmds->nextTs) < 0) {
+      continue;
+    }
+    if (cmds->retries > CMD_MAX_RETRIES) {
+      cmds->status = CMD_FAILED;
+      cmds->pending = 0;
+      cmds->failed++;
+      return;
+    }
+    IonoLoRaRemoteSlave *slave = &slavesBuffer[idx];
+    unsigned long toa = DutyCycle.timeOnAir(DutyCycle.sf, DC_CMD_LEN);
+    int relays = 0;
+    for (int i = 0; i < 4; i++) {
+      if (cmds->pending & (1 << i)) {
+        relays++;
+      }
+    }
+    if (relays > 0 && !DutyCycle.admit(relays * toa, true)) {
+      if (!(cmds->held & CMD_RELAYS)) {
+        cmds->held |= CMD_RELAYS;
+        DutyCycle.deferred++;
+      }
+      if (millis() - cmds->firstTs >= CMD_RETRY_SPAN) {
+        // held for longer than delivering them could take
+        cmds->status = CMD_FAILED;
+        cmds->pending = 0;
+        cmds->failed++;
+        DutyCycle.dropped++;
+      } else {
+        // the whole budget is used, check again later
+        cmds->nextTs = millis() + 1000;
+      }
+      return;
+    }
+    for (int i = 0; i < 4; i++) {
+      byte bit = 1 << i;
+      if (cmds->pending & bit) {
+        slave->write(indexToDO(i + 1), (cmds->relays & bit) ? HIGH : LOW);
+      }
+    }
+    if (cmds->pending & CMD_AO) {
+      if (!DutyCycle.admit(toa, false)) {
+        if (!(cmds->held & CMD_AO)) {
+          cmds->held |= CMD_AO;
+          DutyCycle.rejected++;
+        }
+        if ((cmds->pending & ~CMD_AO) == 0) {
+          // nothing sent, check again later
+          cmds->nextTs = millis() + 1000;
+          return;
+        }
+      } else {
+        slave->write(AO1, cmds->ao / 1000.0);
+      }
+    }
+    if (cmds->retries > 0) {
+      cmds->resent++;
+    }
+    cmds->sendTs = millis();
+    cmds->nextTs = cmds->sendTs + ((unsigned long) CMD_RETRY_TIME << min(cmds->retries, (byte) 4));
+    cmds->retries++;
+    return;
+  }
+}
+
+/*
+  Returns true if the last state reported by the remote unit matches the
+  pending commands
+*/
+bool outputsMatch(int idx) {
+  SlaveCommands *cmds = &slavesCmds[idx];
+  for (int i = 0; i < 4; i++) {
+    byte bit = 1 << i;
+    if ((cmds->pending & bit) && ((cmds->relays & bit) != 0) != (slavesImage[idx][IMG_DO + i] != 0)) {
+      return false;
+    }
+  }
+  if (cmds->pending & CMD_AO) {
+    word ao = slavesImage[idx][IMG_AO];
+    if (ao == 0xFFFF || ao + 10 < cmds->ao || ao > cmds->ao + 10) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void commandsDelivered(int idx) {
+  SlaveCommands *cmds = &slavesCmds[idx];
+  SlaveStats *stats = &slavesStats[idx];
+  cmds->pending = 0;
+  cmds->status = CMD_IDLE;
+  unsigned long elapsed = stats->updateHi - cmds->firstTs;
+  if ((long) elapsed > 0) {
+    stats->latency = min(elapsed, 0xFFFFul);
+    stats->latencyMax = max(stats->latency, stats->latencyMax);
+  }
+}
+
+/*
+  Returns the lowest spreading factor at which the last packet received
+  from the remote unit would have been demodulated with SF_MARGIN dB to
+  spare, based on its SNR. The SNR demodulation floor is -7.5 dB at SF7
+  and decreases by 2.5 dB per SF step.
+  Returns 12 if no packet has been received from the unit.
+*/
+byte safeSf(IonoLoRaRemoteSlave *slave) {
+  if (slave->stateAge() == 0xFFFF) {
+    return 12;
+  }
+  float snr = slave->loraSnr();
+  for (byte sf = 7; sf < 12; sf++) {
+    if (snr + 7.5 + (sf - 7) * 2.5 >= SF_MARGIN) {
+      return sf;
+    }
+  }
+  return 12;
+}
+
+/*
+  Returns the lowest spreading factor safe for all the remote units
+*/
+byte siteSafeSf() {
+  byte sf = 7;
+  for (int i = 0; i < slavesIndexed; i++) {
+    sf = max(sf, safeSf(&slavesBuffer[i]));
+  }
+  return sf;
+}
+
+bool isStale(IonoLoRaRemoteSlave *slave) {
+  return SerialConfig.maxAge > 0 && slave->stateAge() > SerialConfig.maxAge;
+}
+
+/*
+  Re-encodes the register images of the remote units that sent a state
+  update since the last call, so that Modbus reads are served from
+  pre-encoded words
+*/
+void refreshUpdatedImages() {
+  for (int i = 0; i < slavesIndexed; i++) {
+    refreshIfUpdated(i);
+  }
+}
+
+void refreshIfUpdated(int idx) {
+  byte update = checkUpdate(idx);
+  if (update != UPDATE_NONE) {
+    refreshImage(idx, update);
+  } else if (slavesCmds[idx].status == CMD_PENDING) {
+    // the last update may now be known to follow the send
+    updateStats(idx, false);
+  }
+}
+
+/*
+  Tracks the receive time of the last state update of the remote unit,
+  known from stateAge() with 1 second resolution, as an interval that
+  narrows at each call. An update is detected on the first call after
+  it when received more than 1 second after the previous one, within 1
+  second otherwise.
+*/
+byte checkUpdate(int idx) {
+  SlaveStats *stats = &slavesStats[idx];
+  word age = slavesBuffer[idx].stateAge();
+  if (age == 0xFFFF) {
+    return UPDATE_NONE;
+  }
+  unsigned long hi = millis() - age * 1000ul;
+  unsigned long lo = hi - 999;
+  if (!stats->received || (long) (lo - stats->updateHi) > 0) {
+    byte update = stats->received ? UPDATE_NEW : UPDATE_FIRST;
+    stats->received = true;
+    stats->updateLo = lo;
+    stats->updateHi = hi;
+    return update;
+  }
+  if ((long) (lo - stats->updateLo) > 0) {
+    stats->updateLo = lo;
+  }
+  if ((long) (hi - stats->updateHi) < 0) {
+    stats->updateHi = hi;
+  }
+  return UPDATE_NONE;
+}
+
+void refreshImage(int idx, byte update) {
+  IonoLoRaRemoteSlave *slave = &slavesBuffer[idx];
+  word *image = slavesImage[idx];
+  word prev[12];
+  if (update == UPDATE_NEW) {
+    memcpy(prev, image + IMG_DI, 6 * sizeof(word));
+    memcpy(prev + 6, image + IMG_DI_COUNT, 6 * sizeof(word));
+  }
+  for (int i = 0; i < REGISTERS_NUM; i++) {
+    const RegisterRange *reg = &REGISTERS[i];
+    if (reg->offset != IMG_NONE) {
+      for (int j = 0; j <= reg->last - reg->first; j++) {
+        image[reg->offset + j] = readRegister(slave, reg, j + 1);
+      }
+    }
+  }
+  if (update == UPDATE_NEW) {
+    logEvents(idx, prev, prev + 6, slave->stateAge());
+  }
+  updateStats(idx, update != UPDATE_NONE);
+}
+
+/*
+  Logs an event for each digital input whose state or counter changed
+  with the last state update, timestamped with the update's time
+  (1 second resolution). Pulses shorter than the updates interval show
+  up as counter increments.
+*/
+void logEvents(int idx, word *prevStates, word *prevCounts, word age) {
+  word *image = slavesImage[idx];
+  uint32_t ts = SiteClock.now() - age;
+  for (int i = 0; i < 6; i++) {
+    word pulses = image[IMG_DI_COUNT + i] - prevCounts[i];
+    if (pulses != 0 || image[IMG_DI + i] != prevStates[i]) {
+      Events.add(slavesBuffer[idx].getAddr(), i + 1, image[IMG_DI + i], pulses, ts);
+    }
+  }
+}
+
+/*
+  Counts the state updates received from the remote unit and confirms
+  the pending commands on the first state update, received after the
+  last send, reporting the commanded outputs state.
+  Measures have the resolution of the update's receive time bounds:
+  an update is known to be received after the send only once its lower
+  bound follows it.
+*/
+void updateStats(int idx, bool updated) {
+  SlaveStats *stats = &slavesStats[idx];
+  if (updated) {
+    stats->updates++;
+  }
+  SlaveCommands *cmds = &slavesCmds[idx];
+  if (cmds->status != CMD_PENDING || cmds->retries == 0 || !stats->received) {
+    return;
+  }
+  if ((long) (stats->updateLo - cmds->sendTs) <= 0) {
+    // last update possibly older than the command
+    return;
+  }
+  if (outputsMatch(idx)) {
+    commandsDelivered(idx);
+  } else if (updated && (long) (cmds->nextTs - (cmds->sendTs + CMD_UPLINK_DELAY)) > 0) {
+    // the unit listens right after sending an update, e.g. in low-power
+    // mode: the queued commands are re-sent without waiting the backoff
+    cmds->nextTs = cmds->sendTs + CMD_UPLINK_DELAY;
+  }
+}
+
+void clearSlavesIndex() {
+  for (int i = 0; i < 256; i++) {
+    slavesByAddr[i] = NULL;
+  }
+  slavesIndexed = 0;
+}
+
+/*
+  Rebuilds the address index if an indexed slave's address changed since
+  the last call, so that the slave is found at its new address
+*/
+void checkSlavesIndex() {
+  for (int i = 0; i < slavesIndexed; i++) {
+    if (slavesByAddr[slavesRefsBuffer[i]->getAddr()] != &slavesBuffer[i]) {
+      clearSlavesIndex();
+      indexSlaves();
+      return;
+    }
+  }
+}
+
+/*
+  Adds to the address index the slaves that got an address since the last
+  call. Discovery assigns the buffer entries in order, so only the entries
+  following the last indexed one need to be checked.
+  Returns true if any new slave has been indexed.
+*/
+bool indexSlaves() {
+  bool added = false;
+  while (slavesIndexed < slavesMax) {
+    byte addr = slavesRefsBuffer[slavesIndexed]->getAddr();
+    if (addr == 0) {
+      break;
+    }
+    slavesByAddr[addr] = &slavesBuffer[slavesIndexed];
+    refreshImage(slavesIndexed, checkUpdate(slavesIndexed));
+    slavesIndexed++;
+    added = true;
+  }
+  return added;
+}
+
+word analogToRegister(float val, word scale) {
   if (val < 0) {
     return 0xFFFF;
   }
-  return val * 1000;
+  return val * scale + 0.5;
 }
 
+const uint8_t DO_PINS[] = {DO1, DO2, DO3, DO4, DO5, DO6};
+const uint8_t DI_PINS[] = {DI1, DI2, DI3, DI4, DI5, DI6};
+const uint8_t AV_PINS[] = {AV1, AV2, AV3, AV4};
+const uint8_t AI_PINS[] = {AI1, AI2, AI3, AI4};
+
 uint8_t indexToDO(int i) {
-  switch (i) {
-    case 1:
-      return DO1;
-    case 2:
-      return DO2;
-    case 3:
-      return DO3;
-    case 4:
-      return DO4;
-    case 5:
-      return DO5;
-    case 6:
-      return DO6;
-  }
+  return DO_PINS[i - 1];
 }
 
 uint8_t indexToDI(int i) {
-  switch (i) {
-    case 1:
-      return DI1;
-    case 2:
-      return DI2;
-    case 3:
-      return DI3;
-    case 4:
-      return DI4;
-    case 5:
-      return DI5;
-    case 6:
-      return DI6;
-  }
+  return DI_PINS[i - 1];
 }
 
 uint8_t indexToAV(int i) {
-  switch (i) {
-    case 1:
-      return AV1;
-    case 2:
-      return AV2;
-    case 3:
-      return AV3;
-    case 4:
-      return AV4;
-  }
+  return AV_PINS[i - 1];
 }
 
 uint8_t indexToAI(int i) {
-  switch (i) {
-    case 1:
-      return AI1;
-    case 2:
-      return AI2;
-    case 3:
-      return AI3;
-    case 4:
-      return AI4;
-  }
+  return AI_PINS[i - 1];
 }
@@ -0,0 +1,163 @@
+/*
+  LowPower.h
+
+    Copyright (C) 2018-2022 Sfera Labs S.r.l. - All rights reserved.
+
+    For information, see:
+    http://www.sferalabs.cc/
+
+  This code is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+  See file LICENSE.txt for further informations on licensing terms.
+*/
+
+#ifndef LowPower_h
+#define LowPower_h
+
+#include <LoRa.h>
+#include "Reports.h"
+#include "Watchdog.h"
+
+#define LP_DEFAULT_WINDOW 1000  // [ms] receive window length
+
+// Current draw model [mA]
+#define LP_I_MCU    6.0     // MCU, running: woken by the SysTick every 1 ms
+#define LP_I_RX     11.5    // radio receiving
+#define LP_I_TX     90.0    // radio transmitting at +17 dBm
+#define LP_I_SLEEP  0.001   // radio sleeping
+
+/*
+  Low-power mode of remote units: the radio sleeps and is only woken
+  for a receive window after each state update sent, when the gateway
+  sends the queued commands. A state update, and thus a window, is sent
+  at least once every window period.
+  Only the radio sleeps. Between loop cycles the MCU idles until the next
+  interrupt, but the 1 ms SysTick, which keeps the inputs sampling and
+  the watchdog clearing running, wakes it right away: its current draw
+  is about the same as when running. The time spent by the radio in each
+  state is accounted to estimate the mean current draw of the MCU and
+  the radio.
+*/
+class LowPower {
+  private:
+    static unsigned long _window;
+    static unsigned long _toa;
+    static unsigned long _windowTs;
+    static unsigned long _startTs;
+    static unsigned long _accTs;
+    static unsigned long _rxMs;
+    static unsigned long _txMs;
+    static word _sent;
+    static bool _awake;
+
+  public:
+    static bool enabled;
+
+    static void setup(bool enabled, uint16_t window, unsigned long toa);
+    static bool isAwake();
+    static void process();
+    static float rxRatio();
+    static float current();
+};
+
+unsigned long LowPower::_window = LP_DEFAULT_WINDOW;
+unsigned long LowPower::_toa = 0;
+unsigned long LowPower::_windowTs;
+unsigned long LowPower::_startTs;
+unsigned long LowPower::_accTs;
+unsigned long LowPower::_rxMs = 0;
+unsigned long LowPower::_txMs = 0;
+word LowPower::_sent = 0;
+bool LowPower::_awake = true;
+bool LowPower::enabled = false;
+
+/*
+  window in milliseconds, toa in milliseconds, the time-on-air of an
+  update. When not enabled the radio is always receiving, and only
+  accounted.
+*/
+void LowPower::setup(bool enabled, uint16_t window, unsigned long toa) {
+  LowPower::enabled = enabled;
+  _window = window;
+  _toa = toa;
+  _startTs = millis();
+  _accTs = _startTs;
+  _windowTs = _startTs;
+  _rxMs = 0;
+  _txMs = 0;
+  _sent = Reports.sent;
+  _awake = true;
+}
+
+/*
+  Returns true if the radio must be served by the LoRaNet slave
+*/
+bool LowPower::isAwake() {
+  return _awake;
+}
+
+void LowPower::process() {
+  unsigned long ts = millis();
+  if (_awake) {
+    _rxMs += ts - _accTs;
+  }
+  _accTs = ts;
+  if (Reports.sent != _sent) {
+    _txMs += (word) (Reports.sent - _sent) * _toa;
+    _sent = Reports.sent;
+    _windowTs = ts;
+    if (!_awake) {
+      // the radio is woken by the LoRaNet slave to send the update
+      _awake = true;
+      Reports.sense = true;
+    }
+  }
+  if (!enabled) {
+    return;
+  }
+  if (_awake && ts - _windowTs >= _window) {
+    LoRa.sleep();
+    _awake = false;
+    Reports.sense = false;
+  }
+  if (!_awake) {
+    unsigned long idleTs = millis();
+#ifdef ARDUINO_ARCH_SAMD
+    __WFI();
+#endif
+    Watchdog.idle(millis() - idleTs);
+  }
+}
+
+/*
+  Fraction of the time the radio has been receiving since startup
+*/
+float LowPower::rxRatio() {
+  unsigned long total = millis() - _startTs;
+  if (total == 0) {
+    return 1;
+  }
+  return (float) _rxMs / total;
+}
+
+/*
+  Estimated mean current draw [mA] of the MCU and the radio since startup
+*/
+float LowPower::current() {
+  unsigned long total = millis() - _startTs;
+  if (total == 0) {
+    return LP_I_MCU + LP_I_RX;
+  }
+  // transmissions happen while the radio is awake
+  unsigned long rxMs = min(_rxMs, total);
+  unsigned long txMs = min(_txMs, rxMs);
+  unsigned long sleepMs = total - rxMs;
+  rxMs -= txMs;
+  return LP_I_MCU + (txMs * LP_I_TX + rxMs * LP_I_RX + sleepMs * LP_I_SLEEP) / total;
+}
+
+extern LowPower LowPower;
+
+#endif
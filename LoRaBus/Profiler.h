@@ -0,0 +1,142 @@
+/*
+  Profiler.h
+
+    Copyright (C) 2018-2022 Sfera Labs S.r.l. - All rights reserved.
+
+    For information, see:
+    http://www.sferalabs.cc/
+
+  This code is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+  See file LICENSE.txt for further informations on licensing terms.
+*/
+
+#ifndef Profiler_h
+#define Profiler_h
+
+// Comment out to remove the loop profiler
+#define PROFILER
+
+#define PRF_LOOP      0
+#define PRF_LORA      1
+#define PRF_CONFIG    2
+#define PRF_IONO      3
+#define PRF_MODBUS    4
+#define PRF_IMAGE     5
+#define PRF_CMDS      6
+#define PRF_COUNTERS  7
+#define PRF_STAGES    8
+
+#define PRF_BUCKETS   8
+
+#ifdef PROFILER
+
+#define PROFILE_START() Profiler.start()
+#define PROFILE_STAGE(s) Profiler.stage(s)
+#define PROFILE_END() Profiler.end()
+
+const char *const PRF_NAMES[] = {"Loop", "LoRa", "Config", "Iono", "Modbus",
+    "Image", "Cmds", "Counts"};
+
+class Profiler {
+  private:
+    static unsigned long _loopTs;
+    static unsigned long _stageTs;
+    static unsigned long _times[PRF_STAGES];
+    static bool _ran[PRF_STAGES];
+
+    static void _add(int s, unsigned long t);
+
+  public:
+    static unsigned long maxTime[PRF_STAGES];
+    static word histogram[PRF_STAGES][PRF_BUCKETS];
+
+    static void start();
+    static void stage(int s);
+    static void end();
+    static bool read(word regAddr, word *value);
+};
+
+unsigned long Profiler::_loopTs;
+unsigned long Profiler::_stageTs;
+unsigned long Profiler::_times[PRF_STAGES];
+bool Profiler::_ran[PRF_STAGES];
+unsigned long Profiler::maxTime[PRF_STAGES];
+word Profiler::histogram[PRF_STAGES][PRF_BUCKETS];
+
+void Profiler::start() {
+  _loopTs = micros();
+  _stageTs = _loopTs;
+}
+
+/*
+  Accounts the time elapsed since the previous stage (or the loop start)
+  to stage s. A stage run more than once in a loop is recorded once, with
+  the sum of its times.
+*/
+void Profiler::stage(int s) {
+  unsigned long now = micros();
+  _times[s] = (_ran[s] ? _times[s] : 0) + (now - _stageTs);
+  _ran[s] = true;
+  _stageTs = now;
+}
+
+void Profiler::end() {
+  _add(PRF_LOOP, micros() - _loopTs);
+  for (int s = PRF_LOOP + 1; s < PRF_STAGES; s++) {
+    if (_ran[s]) {
+      _add(s, _times[s]);
+      _ran[s] = false;
+    }
+  }
+}
+
+/*
+  Bucket b counts the times below 2^(b+6) us (64us, 128us, ... 4096us),
+  the last bucket counts the times of 4096us and above
+*/
+void Profiler::_add(int s, unsigned long t) {
+  if (t > maxTime[s]) {
+    maxTime[s] = t;
+  }
+  int b = 0;
+  while (b < PRF_BUCKETS - 1 && t >= (64ul << b)) {
+    b++;
+  }
+  histogram[s][b]++;
+}
+
+/*
+  Registers layout: 5310 + 10 * stage = max time [us] (capped at 65535),
+  5311 + 10 * stage + bucket = histogram bucket count
+*/
+bool Profiler::read(word regAddr, word *value) {
+  if (regAddr < 5310 || regAddr >= 5310 + 10 * PRF_STAGES) {
+    return false;
+  }
+  int s = (regAddr - 5310) / 10;
+  int i = (regAddr - 5310) % 10;
+  if (i == 0) {
+    *value = min(maxTime[s], 0xFFFFul);
+    return true;
+  }
+  if (i <= PRF_BUCKETS) {
+    *value = histogram[s][i - 1];
+    return true;
+  }
+  return false;
+}
+
+extern Profiler Profiler;
+
+#else
+
+#define PROFILE_START()
+#define PROFILE_STAGE(s)
+#define PROFILE_END()
+
+#endif
+
+#endif
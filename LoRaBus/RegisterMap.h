@@ -0,0 +1,137 @@
+/*
+  RegisterMap.h
+
+    Copyright (C) 2018-2022 Sfera Labs S.r.l. - All rights reserved.
+
+    For information, see:
+    http://www.sferalabs.cc/
+
+  This code is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+  See file LICENSE.txt for further informations on licensing terms.
+*/
+
+#ifndef RegisterMap_h
+#define RegisterMap_h
+
+#include <IonoModbusRtuSlave.h>
+
+#ifndef MB_FC_WRITE_MULTIPLE_REGISTERS
+#define MB_FC_WRITE_MULTIPLE_REGISTERS 0x10
+#endif
+
+#define FC(f) (1ul << (f))
+
+enum RegisterType {
+  REG_DO,
+  REG_DI,
+  REG_AV,
+  REG_AI,
+  REG_AO,
+  REG_DI_COUNT,
+  REG_RSSI,
+  REG_SNR,
+  REG_SF,
+  REG_AGE,
+  REG_SKIPPED_WRITES,  // output writes not sent, the outputs being already in that state
+  REG_LATENCY,
+  REG_LATENCY_MAX,
+  REG_UPDATES,
+  REG_UPDATE_TIME,
+  REG_CMD,
+  REG_ID
+};
+
+#define IMG_DO        0
+#define IMG_DI        4
+#define IMG_AV        10
+#define IMG_AI        14
+#define IMG_AO        18
+#define IMG_DI_COUNT  19
+#define IMG_RSSI      25
+#define IMG_SNR       26
+#define IMG_SIZE      27
+#define IMG_NONE      0xFF
+
+struct RegisterRange {
+  word first;
+  word last;
+  uint32_t functions;
+  byte type;
+  word scale;
+  byte offset;
+};
+
+/*
+  Registers of the remote units, sorted by address.
+  The offset is the position of the first register in the remote unit's
+  register image, or IMG_NONE for registers computed on each request.
+  Adding a range here makes it available to the Modbus handler,
+  keep the table sorted (checked at compile time) and non-overlapping.
+*/
+constexpr RegisterRange REGISTERS[] = {
+  {1,    4,    FC(MB_FC_READ_COILS) | FC(MB_FC_WRITE_SINGLE_COIL) | FC(MB_FC_WRITE_MULTIPLE_COILS), REG_DO, 1, IMG_DO},
+  {99,   99,   FC(MB_FC_READ_INPUT_REGISTER), REG_ID, 1, IMG_NONE},
+  {101,  106,  FC(MB_FC_READ_DISCRETE_INPUTS), REG_DI, 1, IMG_DI},
+  {201,  204,  FC(MB_FC_READ_INPUT_REGISTER), REG_AV, 1000, IMG_AV},
+  {301,  304,  FC(MB_FC_READ_INPUT_REGISTER), REG_AI, 1000, IMG_AI},
+  {601,  601,  FC(MB_FC_READ_HOLDING_REGISTERS) | FC(MB_FC_WRITE_SINGLE_REGISTER) | FC(MB_FC_WRITE_MULTIPLE_REGISTERS), REG_AO, 1000, IMG_AO},
+  {1001, 1006, FC(MB_FC_READ_INPUT_REGISTER), REG_DI_COUNT, 1, IMG_DI_COUNT},
+  {5001, 5001, FC(MB_FC_READ_INPUT_REGISTER), REG_RSSI, 1, IMG_RSSI},
+  {5002, 5002, FC(MB_FC_READ_INPUT_REGISTER), REG_SNR, 1000, IMG_SNR},
+  {5003, 5003, FC(MB_FC_READ_INPUT_REGISTER), REG_SF, 1, IMG_NONE},
+  {5101, 5101, FC(MB_FC_READ_INPUT_REGISTER), REG_AGE, 1, IMG_NONE},
+  {5102, 5102, FC(MB_FC_READ_INPUT_REGISTER), REG_SKIPPED_WRITES, 1, IMG_NONE},
+  {5103, 5104, FC(MB_FC_READ_INPUT_REGISTER), REG_UPDATE_TIME, 1, IMG_NONE},
+  {5111, 5111, FC(MB_FC_READ_INPUT_REGISTER), REG_LATENCY, 1, IMG_NONE},
+  {5112, 5112, FC(MB_FC_READ_INPUT_REGISTER), REG_LATENCY_MAX, 1, IMG_NONE},
+  {5113, 5113, FC(MB_FC_READ_INPUT_REGISTER), REG_UPDATES, 1, IMG_NONE},
+  {5401, 5405, FC(MB_FC_READ_INPUT_REGISTER), REG_CMD, 1, IMG_NONE},
+};
+
+constexpr int REGISTERS_NUM = sizeof(REGISTERS) / sizeof(RegisterRange);
+
+constexpr bool _registersSorted(int i) {
+  return i >= REGISTERS_NUM - 1 ||
+      (REGISTERS[i].first <= REGISTERS[i].last &&
+        REGISTERS[i].last < REGISTERS[i + 1].first &&
+        _registersSorted(i + 1));
+}
+
+static_assert(_registersSorted(0), "REGISTERS must be sorted and non-overlapping");
+
+class RegisterMap {
+  public:
+    static const RegisterRange *find(byte function, word regAddr, word qty);
+};
+
+/*
+  Returns the range containing all the qty registers starting at regAddr
+  and supporting the specified function, or NULL if there is none.
+*/
+const RegisterRange *RegisterMap::find(byte function, word regAddr, word qty) {
+  int lo = 0;
+  int hi = REGISTERS_NUM - 1;
+  while (lo <= hi) {
+    int mid = (lo + hi) / 2;
+    const RegisterRange *r = &REGISTERS[mid];
+    if (regAddr < r->first) {
+      hi = mid - 1;
+    } else if (regAddr > r->last) {
+      lo = mid + 1;
+    } else {
+      if (qty < 1 || regAddr + qty > r->last + 1 || function >= 32 ||
+          (r->functions & FC(function)) == 0) {
+        return NULL;
+      }
+      return r;
+    }
+  }
+  return NULL;
+}
+
+extern RegisterMap RegisterMap;
+
+#endif
@@ -0,0 +1,290 @@
+/*
+  Reports.h
+
+    Copyright (C) 2018-2022 Sfera Labs S.r.l. - All rights reserved.
+
+    For information, see:
+    http://www.sferalabs.cc/
+
+  This code is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+  See file LICENSE.txt for further informations on licensing terms.
+*/
+
+#ifndef Reports_h
+#define Reports_h
+
+#include <Iono.h>
+#include <LoRa.h>
+#include <IonoLoRaNet.h>
+#include "DutyCycle.h"
+
+#define REPORTS_MAX_PENDING   12
+#define REPORTS_MAX_STEPS     4
+#define REPORTS_BACKOFF_SLOTS 16    // startup backoff slots, by unit address
+#define REPORTS_BUSY_RSSI     -90   // [dBm] channel considered busy above this RSSI
+#define REPORTS_DC_RETRY      1000  // [ms] hold time while the duty cycle budget is used
+
+/*
+  Sits between the Iono subscriptions and the LoRaNet local slave on
+  remote units: input variations are held for the aggregation delay and
+  forwarded together, so that they go out in the same state update,
+  and the state is re-sent after the heartbeat period with no updates.
+  To avoid collisions when many units start together, e.g. at a power
+  return, reports are held after startup for a backoff scaled by the unit
+  address. Aggregated reports get a random jitter, and no report is
+  forwarded while the channel is busy.
+  Each report is admitted by DutyCycle, outputs changes with priority:
+  reports out of budget are held and forwarded together later.
+*/
+class Reports {
+  private:
+    static unsigned long _aggrDelay;
+    static unsigned long _hbPeriod;
+    static uint8_t _pins[REPORTS_MAX_PENDING];
+    static float _values[REPORTS_MAX_PENDING];
+    static int _pendingNum;
+    static unsigned long _pendingTs;
+    static unsigned long _lastTs;
+    static uint8_t _stepPins[REPORTS_MAX_STEPS];
+    static float _steps[REPORTS_MAX_STEPS];
+    static float _stepValues[REPORTS_MAX_STEPS];
+    static int _stepsNum;
+    static unsigned long _slot;
+    static unsigned long _jitter;
+    static unsigned long _holdTs;
+    static bool _held;
+    static unsigned long _waitTs;
+    static bool _waiting;
+
+    static void _add(uint8_t pin, float value);
+    static void _flush();
+    static int _stepIndex(uint8_t pin);
+    static float _quantize(int s, float value);
+    static bool _clearToSend(bool priority);
+    static bool _canSend(bool priority);
+    static bool _hasOutputs();
+
+  public:
+    static word deferred;
+    static word held;
+    static word delayMax;
+    static word sent;
+    static bool sense;
+
+    static void setup(uint16_t aggrDelay, uint16_t hbPeriod, byte address, unsigned long slot);
+    static void setStep(uint8_t pin, float step);
+    static void subscribeCallback(uint8_t pin, float value);
+    static void outputCallback(uint8_t pin, float value);
+    static void process();
+};
+
+unsigned long Reports::_aggrDelay = 0;
+unsigned long Reports::_hbPeriod = 0;
+uint8_t Reports::_pins[REPORTS_MAX_PENDING];
+float Reports::_values[REPORTS_MAX_PENDING];
+int Reports::_pendingNum = 0;
+unsigned long Reports::_pendingTs;
+unsigned long Reports::_lastTs;
+uint8_t Reports::_stepPins[REPORTS_MAX_STEPS];
+float Reports::_steps[REPORTS_MAX_STEPS];
+float Reports::_stepValues[REPORTS_MAX_STEPS];
+int Reports::_stepsNum = 0;
+unsigned long Reports::_slot;
+unsigned long Reports::_jitter = 0;
+unsigned long Reports::_holdTs;
+bool Reports::_held = false;
+unsigned long Reports::_waitTs;
+bool Reports::_waiting = false;
+word Reports::deferred = 0;
+word Reports::held = 0;
+word Reports::delayMax = 0;
+word Reports::sent = 0;
+bool Reports::sense = true;
+
+/*
+  aggrDelay in milliseconds, hbPeriod in seconds, 0 to disable,
+  slot in milliseconds, about the time-on-air of an update
+*/
+void Reports::setup(uint16_t aggrDelay, uint16_t hbPeriod, byte address, unsigned long slot) {
+  _aggrDelay = aggrDelay;
+  _hbPeriod = hbPeriod * 1000ul;
+  _lastTs = millis();
+  _slot = max(slot, 1ul);
+  randomSeed(micros() + address * 7919ul);
+  _holdTs = millis() + (address % REPORTS_BACKOFF_SLOTS) * _slot + random(_slot);
+  _held = true;
+}
+
+/*
+  Returns true if reports can be forwarded now, keeping count of the
+  holds and of the max time [ms] a report waited to be forwarded
+*/
+bool Reports::_clearToSend(bool priority) {
+  if (!_canSend(priority)) {
+    if (!_waiting) {
+      _waitTs = millis();
+      _waiting = true;
+    }
+    return false;
+  }
+  if (_waiting) {
+    delayMax = max(delayMax, (word) min(millis() - _waitTs, 0xFFFFul));
+    _waiting = false;
+  }
+  return true;
+}
+
+/*
+  The hold time is over, the channel is free and the update fits in the
+  duty cycle budget. If the channel is busy, reports are held for a
+  random backoff of one to two slots. The channel is not sensed when
+  sense is false, i.e. while the radio sleeps.
+*/
+bool Reports::_canSend(bool priority) {
+  if (_held) {
+    if ((long) (millis() - _holdTs) < 0) {
+      return false;
+    }
+    _held = false;
+  }
+  if (sense && LoRa.rssi() > REPORTS_BUSY_RSSI) {
+    deferred++;
+    _holdTs = millis() + _slot + random(_slot);
+    _held = true;
+    return false;
+  }
+  // the slot is about the time-on-air of an update
+  if (!DutyCycle.admit(_slot, priority)) {
+    held++;
+    _holdTs = millis() + REPORTS_DC_RETRY;
+    _held = true;
+    return false;
+  }
+  return true;
+}
+
+bool Reports::_hasOutputs() {
+  for (int i = 0; i < _pendingNum; i++) {
+    uint8_t pin = _pins[i];
+    if (pin == DO1 || pin == DO2 || pin == DO3 || pin == DO4 || pin == AO1) {
+      return true;
+    }
+  }
+  return false;
+}
+
+/*
+  Sets the quantization step of an analog input's reported values. The
+  input must be subscribed with no min variation: a value is reported
+  when the input is one step away from the last reported one, so that
+  the two never differ by more than the step.
+*/
+void Reports::setStep(uint8_t pin, float step) {
+  if (_stepsNum < REPORTS_MAX_STEPS && step > 0) {
+    _stepPins[_stepsNum] = pin;
+    _steps[_stepsNum] = step;
+    _stepValues[_stepsNum] = -2;
+    _stepsNum++;
+  }
+}
+
+int Reports::_stepIndex(uint8_t pin) {
+  for (int i = 0; i < _stepsNum; i++) {
+    if (_stepPins[i] == pin) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+float Reports::_quantize(int s, float value) {
+  if (value < 0) {
+    return value;
+  }
+  return ((long) (value / _steps[s] + 0.5)) * _steps[s];
+}
+
+/*
+  Callback for inputs subscriptions. Values of quantized inputs less than
+  one step away from the last reported one are dropped.
+*/
+void Reports::subscribeCallback(uint8_t pin, float value) {
+  int s = _stepIndex(pin);
+  if (s >= 0) {
+    if (fabs(value - _stepValues[s]) < _steps[s]) {
+      return;
+    }
+    value = _quantize(s, value);
+    _stepValues[s] = value;
+  }
+  if (_aggrDelay == 0 && _pendingNum == 0 && _clearToSend(false)) {
+    IonoLoRaLocalSlave::subscribeCallback(pin, value);
+    _lastTs = millis();
+    sent++;
+    return;
+  }
+  _add(pin, value);
+}
+
+void Reports::_add(uint8_t pin, float value) {
+  int i = 0;
+  for (; i < _pendingNum; i++) {
+    if (_pins[i] == pin) {
+      break;
+    }
+  }
+  if (i == _pendingNum) {
+    if (_pendingNum == 0) {
+      _pendingTs = millis();
+      _jitter = _aggrDelay > 0 ? random(_slot) : 0;
+    } else if (_pendingNum >= REPORTS_MAX_PENDING) {
+      _flush();
+      i = 0;
+      _pendingTs = millis();
+    }
+    _pins[i] = pin;
+    _pendingNum++;
+  }
+  _values[i] = value;
+}
+
+/*
+  Callback for outputs subscriptions, forwarded as soon as clear to send
+  together with any pending input variation
+*/
+void Reports::outputCallback(uint8_t pin, float value) {
+  if (!_clearToSend(true)) {
+    _add(pin, value);
+    return;
+  }
+  IonoLoRaLocalSlave::subscribeCallback(pin, value);
+  _flush();
+}
+
+void Reports::_flush() {
+  for (int i = 0; i < _pendingNum; i++) {
+    IonoLoRaLocalSlave::subscribeCallback(_pins[i], _values[i]);
+  }
+  _pendingNum = 0;
+  _lastTs = millis();
+  sent++;
+}
+
+void Reports::process() {
+  if (_pendingNum > 0 && millis() - _pendingTs >= _aggrDelay + _jitter && _clearToSend(_hasOutputs())) {
+    _flush();
+  }
+  if (_hbPeriod > 0 && millis() - _lastTs >= _hbPeriod && _clearToSend(false)) {
+    // DO1 is always subscribed, re-sending it triggers a state update
+    IonoLoRaLocalSlave::subscribeCallback(DO1, Iono.read(DO1));
+    _lastTs = millis();
+    sent++;
+  }
+}
+
+extern Reports Reports;
+
+#endif
@@ -18,13 +18,80 @@
 
 #include <FlashAsEEPROM.h>
 #include <FlashStorage.h>
+#include "ConfigStore.h"
 #include "Watchdog.h"
-
-#define MAX_SLAVES  20
+#include "Profiler.h"
+#include "Diagnostics.h"
+
+// Max number of remote units of a gateway, listed or auto-discovered:
+// their buffers are statically allocated on the gateway
+#define MAX_SLAVES  64
+// Remote units addresses room in the configuration record, kept for its
+// layout
+#define CONFIG_SLAVES 247
+#define CONFIG_VERSION 1
+#define DEFAULT_DEADBAND 100
+#define MAX_GROUPS 4
+#define MAX_PEERS 4
+#define MAX_CHANNELS 8
+#define CHANNEL_HALF_BW 63    // [kHz] half of the 125 kHz channel, rounded up
+#define CHANNEL_SPACING 200   // [kHz] min distance between the gateways of a site
+#define RX_DEFAULT_WINDOW 1000 // [ms] low-power mode receive window length
+#define IMPORT_KEY_LEN 32
+#define IMPORT_VAL_LEN 24
 #define CONSOLE_TIMEOUT 20000
 #define _PORT_USB SERIAL_PORT_MONITOR
 #define _PORT_RS485 SERIAL_PORT_HARDWARE
 
+/*
+  Configuration record data: new fields must be appended, records saved
+  by previous versions are loaded over their defaults
+*/
+struct ConfigData {
+  byte address;
+  byte speed;
+  byte parity;
+  byte txPower;
+  byte sf;
+  uint32_t frequency;
+  uint16_t dc;
+  uint16_t dcWin;
+  byte siteId[3];
+  byte pwd[16];
+  char modes[6];
+  uint16_t inItvl[6];
+  char rules[4];
+  byte slavesNum;
+  byte slavesAddr[CONFIG_SLAVES];
+  uint16_t inDb[4];
+  uint16_t hbPeriod;
+  uint16_t aggrDelay;
+  byte groupsAddr[MAX_GROUPS];
+  byte groupsUnits[MAX_GROUPS][32];
+  byte peersNum;
+  uint32_t peersFreq[MAX_PEERS];
+  byte channelsNum;
+  uint32_t channels[MAX_CHANNELS];
+  uint16_t rxPeriod;
+  uint16_t rxWindow;
+  uint16_t maxAge;
+};
+
+static_assert(sizeof(ConfigData) <= CONFIG_DATA_SIZE, "ConfigData exceeds the record size");
+
+/*
+  Sub-bands of the 863-870 MHz band for short range devices:
+  first and last frequency [kHz], max duty cycle [1/1000]
+*/
+const uint32_t SUB_BANDS[][3] = {
+  {863000, 865000, 1},
+  {865000, 868000, 10},
+  {868000, 868600, 10},
+  {868700, 869200, 1},
+  {869400, 869650, 100},
+  {869700, 870000, 10}
+};
+
 const long SPEEDS[] = {0, 1200, 2400, 4800, 9600, 19200, 38400, 57600, 115200};
 
 class SerialConfig {
@@ -37,8 +104,11 @@ class SerialConfig {
     static void _enterConsole();
     static void _enterConfigWizard();
     static void _exportConfig();
+    static void _printDiagnostics();
     static bool _importConfig();
     static bool _consumeWhites();
+    static bool _endsWith(const char *str, const char *suffix);
+    static int _keyIndex(const char *key, const char *prefix, int num);
     template <typename T>
     static void _print(T text);
     static void _readEchoLine(int maxLen, bool returnOnMaxLen,
@@ -52,20 +122,41 @@ class SerialConfig {
         byte *siteId, byte *pwd, char *modes,
         uint32_t inItvl1, uint32_t inItvl2, uint32_t inItvl3,
         uint32_t inItvl4, uint32_t inItvl5, uint32_t inItvl6,
-        char *rules, byte *slavesAddr, byte slavesNum);
+        char *rules, byte *slavesAddr, byte slavesNum,
+        uint16_t *inDb, uint16_t hbPeriod, uint16_t aggrDelay,
+        byte *groupsAddr, byte (*groupsUnits)[32],
+        uint32_t *peersFreq, byte peersNum,
+        uint32_t *channels, byte channelsNum,
+        uint16_t rxPeriod, uint16_t rxWindow, uint16_t maxAge);
     static void _confirmConfiguration(byte address, byte speed, byte parity,
         uint32_t frequency, byte txPower, byte sf, uint16_t dc, uint16_t dcWin,
         byte *siteId, byte *pwd, char *modes,
         uint32_t inItvl1, uint32_t inItvl2, uint32_t inItvl3,
         uint32_t inItvl4, uint32_t inItvl5, uint32_t inItvl6,
-        char *rules, byte *slavesAddr, byte slavesNum);
+        char *rules, byte *slavesAddr, byte slavesNum,
+        uint16_t *inDb, uint16_t hbPeriod, uint16_t aggrDelay,
+        byte *groupsAddr, byte (*groupsUnits)[32],
+        uint32_t *peersFreq, byte peersNum,
+        uint32_t *channels, byte channelsNum,
+        uint16_t rxPeriod, uint16_t rxWindow, uint16_t maxAge);
+    static int _subBand(uint32_t frequency);
+    static void _checkChannels(uint32_t frequency, uint16_t dc, uint32_t *peersFreq, byte peersNum);
+    static bool _validGroup(int g, int addr, byte address,
+        byte *slavesAddr, byte slavesNum, byte *groupsAddr);
+    static bool _validPeer(uint32_t freq, uint32_t frequency, uint32_t *peersFreq, byte peersNum);
+    static bool _readConfig();
     static bool _readEepromConfig();
-    static bool _writeEepromConfig(byte address, byte speed, byte parity,
+    static bool _writeConfig(byte address, byte speed, byte parity,
         uint32_t frequency, byte txPower, byte sf, uint16_t dc, uint16_t dcWin,
         byte *siteId, byte *pwd, char *modes,
         uint32_t inItvl1, uint32_t inItvl2, uint32_t inItvl3,
         uint32_t inItvl4, uint32_t inItvl5, uint32_t inItvl6,
-        char *rules, byte *slavesAddr, byte slavesNum);
+        char *rules, byte *slavesAddr, byte slavesNum,
+        uint16_t *inDb, uint16_t hbPeriod, uint16_t aggrDelay,
+        byte *groupsAddr, byte (*groupsUnits)[32],
+        uint32_t *peersFreq, byte peersNum,
+        uint32_t *channels, byte channelsNum,
+        uint16_t rxPeriod, uint16_t rxWindow, uint16_t maxAge);
 
   public:
     static bool isConfigured;
@@ -87,9 +178,27 @@ class SerialConfig {
     static char rules[5];
     static byte slavesAddr[MAX_SLAVES];
     static byte slavesNum;
+    static uint16_t inDb[4];
+    static uint16_t hbPeriod;
+    static uint16_t aggrDelay;
+    static byte groupsAddr[MAX_GROUPS];
+    static byte groupsUnits[MAX_GROUPS][32];
+    static uint32_t peersFreq[MAX_PEERS];
+    static byte peersNum;
+    static uint32_t channels[MAX_CHANNELS];
+    static byte channelsNum;
+    static uint16_t rxPeriod;
+    static uint16_t rxWindow;
+    static uint16_t maxAge;
 
     static void setup();
     static void process();
+    static int groupIndex(byte addr);
+    static bool inGroup(int group, byte addr);
+    static bool isGroupResponder();
+    static uint32_t channel();
+    static uint32_t selectChannel(uint32_t frequency, byte *siteId, uint32_t *channels, byte channelsNum);
+    static uint16_t subBandDc(uint32_t frequency);
 };
 
 bool SerialConfig::isConfigured = false;
@@ -115,12 +224,24 @@ uint32_t SerialConfig::inItvl[6];
 char SerialConfig::rules[5];
 byte SerialConfig::slavesAddr[MAX_SLAVES];
 byte SerialConfig::slavesNum;
+uint16_t SerialConfig::inDb[4];
+uint16_t SerialConfig::hbPeriod;
+uint16_t SerialConfig::aggrDelay;
+byte SerialConfig::groupsAddr[MAX_GROUPS];
+byte SerialConfig::groupsUnits[MAX_GROUPS][32];
+uint32_t SerialConfig::peersFreq[MAX_PEERS];
+byte SerialConfig::peersNum = 0;
+uint32_t SerialConfig::channels[MAX_CHANNELS];
+byte SerialConfig::channelsNum = 0;
+uint16_t SerialConfig::rxPeriod = 0;
+uint16_t SerialConfig::rxWindow = RX_DEFAULT_WINDOW;
+uint16_t SerialConfig::maxAge = 0;
 
 void SerialConfig::setup() {
   _PORT_USB.begin(9600);
   _PORT_RS485.begin(9600);
 
-  isConfigured = _readEepromConfig();
+  isConfigured = _readConfig();
 
   if (!isConfigured) {
     address = 1;
@@ -141,11 +262,55 @@ void SerialConfig::setup() {
     strncpy(rules, "----", 4);
     rules[4] = '\0';
     slavesNum = 0;
+    for (int i = 0; i < 4; i++) {
+      inDb[i] = DEFAULT_DEADBAND;
+    }
+    hbPeriod = 0;
+    aggrDelay = 0;
+    for (int g = 0; g < MAX_GROUPS; g++) {
+      groupsAddr[g] = 0;
+    }
+    rxPeriod = 0;
+    rxWindow = RX_DEFAULT_WINDOW;
+    maxAge = 0;
   }
 
   isGateway = (speed >= 1 && speed <= 8);
 }
 
+/*
+  Returns the index of the group with the specified Modbus address,
+  or -1 if none
+*/
+int SerialConfig::groupIndex(byte addr) {
+  if (addr == 0) {
+    return -1;
+  }
+  for (int g = 0; g < MAX_GROUPS; g++) {
+    if (groupsAddr[g] == addr) {
+      return g;
+    }
+  }
+  return -1;
+}
+
+bool SerialConfig::inGroup(int group, byte addr) {
+  return group >= 0 && (groupsUnits[group][addr / 8] & (1 << (addr % 8))) != 0;
+}
+
+/*
+  With more gateways on the site, group writes are answered only by the
+  one on the lowest frequency
+*/
+bool SerialConfig::isGroupResponder() {
+  for (int i = 0; i < peersNum; i++) {
+    if (peersFreq[i] < channel()) {
+      return false;
+    }
+  }
+  return true;
+}
+
 void SerialConfig::process() {
   if (_port == NULL) {
     if (_PORT_USB.available()) {
@@ -192,9 +357,10 @@ void SerialConfig::_enterConsole() {
            "\r\n    1. Configuration wizard"
            "\r\n    2. Import configuration"
            "\r\n    3. Export configuration"
+           "\r\n    4. Show diagnostics"
            "\r\n\r\n> "
          );
-    _readEchoLine(1, false, false, &_betweenFilter, '1', '3');
+    _readEchoLine(1, false, false, &_betweenFilter, '1', '4');
     switch (_inBuffer[0]) {
       case '1':
         _enterConfigWizard();
@@ -210,6 +376,9 @@ void SerialConfig::_enterConsole() {
       case '3':
         _exportConfig();
         break;
+      case '4':
+        _printDiagnostics();
+        break;
       default:
         break;
     }
@@ -232,9 +401,36 @@ bool SerialConfig::_importConfig() {
   char rulesNew[5];
   byte slavesAddrNew[MAX_SLAVES];
   byte slavesNumNew = 0;
-
-  int c, i, n;
-  String l;
+  uint16_t inDbNew[4];
+  uint16_t hbPeriodNew = 0;
+  uint16_t aggrDelayNew = 0;
+  byte groupsAddrNew[MAX_GROUPS];
+  byte groupsUnitsNew[MAX_GROUPS][32];
+  uint32_t peersFreqNew[MAX_PEERS];
+  byte peersNumNew = 0;
+  uint32_t channelsNew[MAX_CHANNELS];
+  byte channelsNumNew = 0;
+  uint16_t rxPeriodNew = 0;
+  uint16_t rxWindowNew = RX_DEFAULT_WINDOW;
+  uint16_t maxAgeNew = 0;
+
+  char key[IMPORT_KEY_LEN + 1];
+  char val[IMPORT_VAL_LEN + 1];
+  int keyLen = 0;
+  int valLen = 0;
+  bool inValue = false;
+  bool isList = false;
+  bool isFreqs = false;
+  bool isChannels = false;
+  int g = -1;
+  int in = -1;
+  long num = -1;
+  long n;
+  int i;
+  char c;
+
+  memset(groupsAddrNew, 0, sizeof(groupsAddrNew));
+  memset(groupsUnitsNew, 0, sizeof(groupsUnitsNew));
 
   siteIdNew[0] = '\0';
   pwdNew[0] = '\0';
@@ -243,65 +439,154 @@ bool SerialConfig::_importConfig() {
   for (int i = 0; i < 6; i++) {
     inItvlNew[i] = 0;
   }
+  for (int i = 0; i < 4; i++) {
+    inDbNew[i] = DEFAULT_DEADBAND;
+  }
 
   _print("\r\nPaste the configuration:\r\n");
   if (!_consumeWhites()) {
     return false;
   }
   _port->setTimeout(300);
+
+  // "key: value" lines, parsed as they are received
   while (true) {
-    l = _port->readStringUntil(':');
-    if (l.endsWith("address")) {
-      addressNew = _port->parseInt();
-    } else if (l.endsWith("frequency")) {
-      frequencyNew = _port->parseInt();
-    } else if (l.endsWith("power")) {
-      txPowerNew = _port->parseInt();
-    } else if (l.endsWith("factor")) {
-      sfNew = _port->parseInt();
-    } else if (l.endsWith("cycle")) {
-      dcNew = _port->parseFloat() * 10;
-    } else if (l.endsWith("window")) {
-      dcWinNew = _port->parseInt();
-    } else if (l.endsWith("ID")) {
-      if (!_consumeWhites()) {
-        return false;
+    if (_port->readBytes(&c, 1) != 1) {
+      // end of the pasted text
+      if (!inValue) {
+        break;
       }
-      n = _port->readBytes(siteIdNew, 3);
-      if (n != 3) {
+      c = '\n';
+    }
+    if (c == '\b' || c == 127 || c == 27) {
+      return false;
+    }
+
+    if (!inValue) {
+      if (c == '\r' || c == '\n') {
+        // line with no value, e.g. the unit type header
+        keyLen = 0;
+      } else if (c == ':') {
+        key[keyLen] = '\0';
+        inValue = true;
+        valLen = 0;
+        num = -1;
+        isFreqs = _endsWith(key, "frequencies");
+        isChannels = _endsWith(key, "channels");
+        isList = isFreqs || isChannels || _endsWith(key, "units");
+        g = _keyIndex(key, "Group ", MAX_GROUPS);
+        in = _keyIndex(key, "Input ", 6);
+        if (strstr(key, "Group ") != NULL && g < 0) {
+          return false;
+        }
+      } else if (keyLen < IMPORT_KEY_LEN) {
+        key[keyLen++] = c;
+      } else {
         return false;
       }
-      siteIdNew[3] = '\0';
-    } else if (l.endsWith("Password")) {
-      if (!_consumeWhites()) {
+      continue;
+    }
+
+    if (isList) {
+      // comma separated numbers, stored as they are parsed
+      if (c >= '0' && c <= '9') {
+        num = (num < 0 ? 0 : num * 10) + (c - '0');
+        if (num > 999999) {
+          return false;
+        }
+        continue;
+      }
+      if (isChannels) {
+        if (num > 0) {
+          if (channelsNumNew >= MAX_CHANNELS || num < 400000l) {
+            return false;
+          }
+          channelsNew[channelsNumNew++] = num;
+        }
+      } else if (isFreqs) {
+        if (num > 0) {
+          if (peersNumNew >= MAX_PEERS) {
+            return false;
+          }
+          peersFreqNew[peersNumNew++] = num;
+        }
+      } else if (num > 0 && num <= 247) {
+        if (g >= 0) {
+          groupsUnitsNew[g][num / 8] |= 1 << (num % 8);
+        } else if (slavesNumNew < MAX_SLAVES) {
+          slavesAddrNew[slavesNumNew++] = num;
+        } else {
+          return false;
+        }
+      }
+      num = -1;
+    } else if (c != '\r' && c != '\n') {
+      if ((c != ' ' && c != '\t') || valLen > 0) {
+        if (valLen < IMPORT_VAL_LEN) {
+          val[valLen++] = c;
+        }
+      }
+      continue;
+    }
+
+    if (c != '\r' && c != '\n') {
+      continue;
+    }
+    inValue = false;
+    keyLen = 0;
+    if (isList) {
+      continue;
+    }
+    val[valLen] = '\0';
+
+    if (g >= 0) {
+      if (!_endsWith(key, "address")) {
         return false;
       }
-      n = _port->readBytes(pwdNew, 16);
-      if (n != 16) {
+      n = atol(val);
+      if (n < 0 || n > 247) {
         return false;
       }
-      pwdNew[16] = '\0';
-    } else if (l.endsWith("modes")) {
-      if (!_consumeWhites()) {
+      groupsAddrNew[g] = n;
+    } else if (_endsWith(key, "address")) {
+      addressNew = atoi(val);
+    } else if (_endsWith(key, "frequency")) {
+      frequencyNew = atol(val);
+    } else if (_endsWith(key, "power")) {
+      txPowerNew = atoi(val);
+    } else if (_endsWith(key, "factor")) {
+      sfNew = atoi(val);
+    } else if (_endsWith(key, "cycle")) {
+      dcNew = atof(val) * 10;
+    } else if (_endsWith(key, "window")) {
+      dcWinNew = atoi(val);
+    } else if (_endsWith(key, "ID")) {
+      if (valLen < 3) {
         return false;
       }
-      n = _port->readBytes(modesNew, 6);
-      if (n != 6) {
+      memcpy(siteIdNew, val, 3);
+      siteIdNew[3] = '\0';
+    } else if (_endsWith(key, "Password")) {
+      if (valLen < 16) {
         return false;
       }
-      modesNew[6] = '\0';
-    } else if (l.endsWith("rules")) {
-      if (!_consumeWhites()) {
+      memcpy(pwdNew, val, 16);
+      pwdNew[16] = '\0';
+    } else if (_endsWith(key, "modes")) {
+      if (valLen < 6) {
         return false;
       }
-      n = _port->readBytes(rulesNew, 4);
-      if (n != 4) {
+      memcpy(modesNew, val, 6);
+      modesNew[6] = '\0';
+    } else if (_endsWith(key, "rules")) {
+      if (valLen < 4) {
         return false;
       }
+      memcpy(rulesNew, val, 4);
       rulesNew[4] = '\0';
-    } else if (l.endsWith("speed")) {
+    } else if (_endsWith(key, "speed")) {
       speedNew = 0;
-      n = _port->parseInt();
+      n = atol(val);
       for (i = 1; i < 9; i++) {
         if (SPEEDS[i] == n) {
           speedNew = i;
@@ -311,63 +596,89 @@ bool SerialConfig::_importConfig() {
       if (speedNew == 0) {
         return false;
       }
-    } else if (l.endsWith("parity")) {
-      if (!_consumeWhites()) {
-        return false;
-      }
-      n = _port->readBytes(_inBuffer, 1);
-      if (n != 1) {
-        return false;
-      }
-      if (_inBuffer[0] == 'E') {
+    } else if (_endsWith(key, "parity")) {
+      if (val[0] == 'E') {
         parityNew = 1;
-      } else if (_inBuffer[0] == 'O') {
+      } else if (val[0] == 'O') {
         parityNew = 2;
-      } else if (_inBuffer[0] == 'N') {
+      } else if (val[0] == 'N') {
         parityNew = 3;
       } else {
         return false;
       }
-    } else if (l.endsWith("units")) {
-      do {
-        n = _port->parseInt();
-        if (n > 0) {
-          slavesAddrNew[slavesNumNew++] = n;
-        } else {
-          break;
-        }
-      } while (slavesNumNew < MAX_SLAVES);
-    } else if (l.endsWith("interval")) {
-      if (l.indexOf("Input 1") >= 0) {
-        inItvlNew[0] = _port->parseInt();
-      } else if (l.indexOf("Input 2") >= 0) {
-        inItvlNew[1] = _port->parseInt();
-      } else if (l.indexOf("Input 3") >= 0) {
-        inItvlNew[2] = _port->parseInt();
-      } else if (l.indexOf("Input 4") >= 0) {
-        inItvlNew[3] = _port->parseInt();
-      } else if (l.indexOf("Input 5") >= 0) {
-        inItvlNew[4] = _port->parseInt();
-      } else if (l.indexOf("Input 6") >= 0) {
-        inItvlNew[5] = _port->parseInt();
-      } else {
+    } else if (_endsWith(key, "interval")) {
+      n = atol(val);
+      if (in < 0 || n < 0 || n > 65535) {
         return false;
       }
-    } else {
-      break;
+      inItvlNew[in] = n;
+    } else if (_endsWith(key, "deadband")) {
+      n = atol(val);
+      if (in < 0 || in >= 4 || n < 1 || n > 30000) {
+        return false;
+      }
+      inDbNew[in] = n;
+    } else if (_endsWith(key, "windows period")) {
+      n = atol(val);
+      if (n != 0 && (n < 10 || n > 120)) {
+        return false;
+      }
+      rxPeriodNew = n;
+    } else if (_endsWith(key, "length")) {
+      n = atol(val);
+      if (n < 100 || n > 10000) {
+        return false;
+      }
+      rxWindowNew = n;
+    } else if (_endsWith(key, "period")) {
+      n = atol(val);
+      if (n != 0 && (n < 10 || n > 65535)) {
+        return false;
+      }
+      hbPeriodNew = n;
+    } else if (_endsWith(key, "delay")) {
+      n = atol(val);
+      if (n < 0 || n > 10000) {
+        return false;
+      }
+      aggrDelayNew = n;
+    } else if (_endsWith(key, "state age")) {
+      n = atol(val);
+      if (n < 0 || n > 65534) {
+        return false;
+      }
+      maxAgeNew = n;
     }
+    // unknown keys are skipped
   }
 
   if (addressNew == 0 || dcNew == 0 || dcWinNew == 0 || siteIdNew[0] == '\0' ||
       pwdNew[0] == '\0' || modesNew[0] == '\0' || rulesNew[0] == '\0') {
     return false;
   }
+  for (g = 0; g < MAX_GROUPS; g++) {
+    if (groupsAddrNew[g] != 0 && !_validGroup(g, groupsAddrNew[g], addressNew,
+        slavesAddrNew, slavesNumNew, groupsAddrNew)) {
+      return false;
+    }
+  }
+  for (i = 0; i < peersNumNew; i++) {
+    if (!_validPeer(peersFreqNew[i], frequencyNew, peersFreqNew, i)) {
+      return false;
+    }
+  }
 
   _confirmConfiguration(addressNew, speedNew, parityNew,
     frequencyNew, txPowerNew, sfNew, dcNew, dcWinNew,
     siteIdNew, pwdNew, modesNew,
     inItvlNew[0], inItvlNew[1], inItvlNew[2], inItvlNew[3], inItvlNew[4], inItvlNew[5],
-    rulesNew, slavesAddrNew, slavesNumNew);
+    rulesNew, slavesAddrNew, slavesNumNew,
+    inDbNew, hbPeriodNew, aggrDelayNew,
+    groupsAddrNew, groupsUnitsNew,
+    peersFreqNew, peersNumNew,
+    channelsNew, channelsNumNew,
+    rxPeriodNew, rxWindowNew, maxAgeNew);
+  return true;
 }
 
 bool SerialConfig::_consumeWhites() {
@@ -387,6 +698,25 @@ bool SerialConfig::_consumeWhites() {
   return true;
 }
 
+bool SerialConfig::_endsWith(const char *str, const char *suffix) {
+  int l = strlen(str);
+  int ls = strlen(suffix);
+  return l >= ls && strcmp(str + l - ls, suffix) == 0;
+}
+
+/*
+  Returns the 0-based index N-1 following the prefix in keys like
+  "Input N ...", or -1 if the prefix is missing or N is out of 1-num
+*/
+int SerialConfig::_keyIndex(const char *key, const char *prefix, int num) {
+  const char *p = strstr(key, prefix);
+  if (p == NULL) {
+    return -1;
+  }
+  int i = p[strlen(prefix)] - '1';
+  return (i >= 0 && i < num) ? i : -1;
+}
+
 void SerialConfig::_exportConfig() {
   if (!isConfigured) {
     _print("\r\nNot configured\r\n\r\n");
@@ -397,7 +727,39 @@ void SerialConfig::_exportConfig() {
     frequency, txPower, sf, dc, dcWin,
     siteId, pwd, modes,
     inItvl[0], inItvl[1], inItvl[2], inItvl[3], inItvl[4], inItvl[5],
-    rules, slavesAddr, slavesNum);
+    rules, slavesAddr, slavesNum,
+    inDb, hbPeriod, aggrDelay,
+    groupsAddr, groupsUnits,
+    peersFreq, peersNum,
+    channels, channelsNum,
+    rxPeriod, rxWindow, maxAge);
+  _print("\r\n");
+}
+
+void SerialConfig::_printDiagnostics() {
+  _print("\r\n");
+  for (int i = 0; i < Diagnostics.num; i++) {
+    _print(Diagnostics.name(i));
+    _print(": ");
+    _print(Diagnostics.read(i));
+    _print("\r\n");
+  }
+#ifdef PROFILER
+  _print("\r\nStage    max[us]  <64us <128us <256us <512us   <1ms   <2ms   <4ms  >=4ms\r\n");
+  for (int s = 0; s < PRF_STAGES; s++) {
+    _print(PRF_NAMES[s]);
+    for (int i = strlen(PRF_NAMES[s]); i < 6; i++) {
+      _print(" ");
+    }
+    sprintf(_inBuffer, "%10lu", Profiler.maxTime[s]);
+    _print(_inBuffer);
+    for (int b = 0; b < PRF_BUCKETS; b++) {
+      sprintf(_inBuffer, " %6u", Profiler.histogram[s][b]);
+      _print(_inBuffer);
+    }
+    _print("\r\n");
+  }
+#endif
   _print("\r\n");
 }
 
@@ -417,6 +779,21 @@ void SerialConfig::_enterConfigWizard() {
   char rulesNew[5];
   byte slavesAddrNew[MAX_SLAVES];
   byte slavesNumNew;
+  uint16_t inDbNew[4];
+  uint16_t hbPeriodNew;
+  uint16_t aggrDelayNew;
+  byte groupsAddrNew[MAX_GROUPS];
+  byte groupsUnitsNew[MAX_GROUPS][32];
+  uint32_t peersFreqNew[MAX_PEERS];
+  byte peersNumNew = 0;
+  uint32_t channelsNew[MAX_CHANNELS];
+  byte channelsNumNew = 0;
+  uint16_t rxPeriodNew = 0;
+  uint16_t rxWindowNew = rxWindow;
+  uint16_t maxAgeNew = maxAge;
+
+  memset(groupsAddrNew, 0, sizeof(groupsAddrNew));
+  memset(groupsUnitsNew, 0, sizeof(groupsUnitsNew));
 
   _print("\r\nSelect mode:\r\n"
          "[Press enter to leave current setting: ");
@@ -469,6 +846,39 @@ void SerialConfig::_enterConfigWizard() {
     }
   } while (frequencyNew < 400000l);
 
+  _print("\r\nEnter the LoRa channels [kHz] the site's channel is selected from, by site ID, followed by '0' when done, or '0' to use the LoRa frequency:\r\n"
+         "[Press enter to leave current setting: ");
+  if (channelsNum > 0) {
+    for (int i = 0; i < channelsNum; i++) {
+      if (i != 0) {
+        _print(", ");
+      }
+      _print(channels[i]);
+    }
+  } else {
+    _print("none");
+  }
+  _print("]\r\n\r\n");
+  long ch;
+  do {
+    _print("> ");
+    _readEchoLine(6, false, false, &_betweenFilter, '0', '9');
+    if (_inBuffer[0] == '\0') {
+      if (channelsNumNew == 0) {
+        memcpy(channelsNew, channels, sizeof(uint32_t) * channelsNum);
+        channelsNumNew = channelsNum;
+      }
+      break;
+    }
+    ch = atol(_inBuffer);
+    if (ch == 0) {
+      break;
+    }
+    if (ch >= 400000l) {
+      channelsNew[channelsNumNew++] = ch;
+    }
+  } while (channelsNumNew < MAX_CHANNELS);
+
   _print("\r\nEnter LoRa TX power (2-20):\r\n"
          "[Press enter to leave current setting: ");
   _print(txPower);
@@ -673,6 +1083,7 @@ void SerialConfig::_enterConfigWizard() {
           } else {
             slavesAddrNew[slavesNumNew++] = slAddr;
             if (slavesNumNew >= MAX_SLAVES) {
+              _print("Max number of remote units reached\r\n");
               break;
             }
           }
@@ -684,14 +1095,116 @@ void SerialConfig::_enterConfigWizard() {
       }
     } while (true);
 
+    _print("\r\nEnter the Modbus address of each group of remote units, '0' to disable the group:\r\n"
+           "[Press enter to leave current setting]\r\n");
+    for (int g = 0; g < MAX_GROUPS; g++) {
+      do {
+        _print("\r\nGroup ");
+        _print(g + 1);
+        _print(" address [current: ");
+        _print(groupsAddr[g]);
+        _print("]:\r\n");
+        _print("> ");
+        _readEchoLine(3, false, false, &_betweenFilter, '0', '9');
+        if (_inBuffer[0] != '\0') {
+          slAddr = atoi(_inBuffer);
+        } else {
+          slAddr = groupsAddr[g];
+        }
+      } while (slAddr != 0 && !_validGroup(g, slAddr, addressNew,
+          slavesAddrNew, slavesNumNew, groupsAddrNew));
+      groupsAddrNew[g] = slAddr;
+      if (slAddr == 0) {
+        continue;
+      }
+
+      _print("Enter the address of each member unit followed by '0' when done:\r\n"
+             "[Press enter to leave current setting]\r\n");
+      bool keep = true;
+      do {
+        _print("> ");
+        _readEchoLine(3, false, false, &_betweenFilter, '0', '9');
+        if (_inBuffer[0] == '\0') {
+          if (keep) {
+            memcpy(groupsUnitsNew[g], groupsUnits[g], 32);
+          }
+          break;
+        }
+        keep = false;
+        slAddr = atoi(_inBuffer);
+        if (slAddr == 0) {
+          break;
+        }
+        if (slAddr <= 247) {
+          groupsUnitsNew[g][slAddr / 8] |= 1 << (slAddr % 8);
+        }
+      } while (true);
+    }
+
+    _print("\r\nEnter the LoRa frequency [kHz] of each other gateway of the site followed by '0' when done:\r\n"
+           "[Press enter to leave current setting: ");
+    if (peersNum > 0) {
+      for (int i = 0; i < peersNum; i++) {
+        if (i != 0) {
+          _print(", ");
+        }
+        _print(peersFreq[i]);
+      }
+    } else {
+      _print("none");
+    }
+    _print("]\r\n\r\n");
+    long peerFreq;
+    do {
+      _print("> ");
+      _readEchoLine(6, false, false, &_betweenFilter, '0', '9');
+      if (_inBuffer[0] == '\0') {
+        if (peersNumNew == 0) {
+          memcpy(peersFreqNew, peersFreq, sizeof(uint32_t) * peersNum);
+          peersNumNew = peersNum;
+        }
+        break;
+      }
+      peerFreq = atol(_inBuffer);
+      if (peerFreq == 0) {
+        break;
+      }
+      if (!_validPeer(peerFreq, frequencyNew, peersFreqNew, peersNumNew)) {
+        continue;
+      }
+      peersFreqNew[peersNumNew++] = peerFreq;
+    } while (peersNumNew < MAX_PEERS);
+
+    _print("\r\nEnter the max age [seconds] of a remote unit's state for its inputs and outputs to be read (0: no limit, 0-65534):\r\n"
+           "[Press enter to leave current setting: ");
+    _print(maxAge);
+    _print("]\r\n\r\n");
+    long age;
+    do {
+      _print("> ");
+      _readEchoLine(5, false, false, &_betweenFilter, '0', '9');
+      if (_inBuffer[0] != '\0') {
+        age = atol(_inBuffer);
+      } else {
+        age = maxAge;
+      }
+    } while (age > 65534);
+    maxAgeNew = age;
+
     for (int i = 0; i < 6; i++) {
       inItvlNew[i] = 0;
     }
+    for (int i = 0; i < 4; i++) {
+      inDbNew[i] = DEFAULT_DEADBAND;
+    }
+    hbPeriodNew = 0;
+    aggrDelayNew = 0;
 
   } else { // remote unit
     speedNew = 0;
     parityNew = 0;
     slavesNumNew = 0;
+    maxAgeNew = 0;
 
     bool hasIns = false;
     for (int i = 0; i < 6; i++) {
@@ -723,13 +1236,114 @@ void SerialConfig::_enterConfigWizard() {
         }
       }
     }
+
+    bool hasAnalogs = false;
+    for (int i = 0; i < 4; i++) {
+      inDbNew[i] = inDb[i];
+      if (modesNew[i] == 'V' || modesNew[i] == 'I') {
+        hasAnalogs = true;
+      }
+    }
+
+    if (hasAnalogs) {
+      _print("\r\nEnter the analog inputs' deadband [mV for voltage, uA for current] (1-30000):\r\n"
+             "[Press enter to leave current setting]\r\n\r\n");
+      long db;
+      for (int i = 0; i < 4; i++) {
+        if (modesNew[i] == 'V' || modesNew[i] == 'I') {
+          do {
+            _print("Input ");
+            _print(i + 1);
+            _print(" [current: ");
+            _print(inDb[i]);
+            _print("]:\r\n");
+            _print("> ");
+            _readEchoLine(5, false, false, &_betweenFilter, '0', '9');
+            if (_inBuffer[0] != '\0') {
+              db = atol(_inBuffer);
+            } else {
+              db = inDb[i];
+            }
+          } while (db < 1 || db > 30000);
+          inDbNew[i] = db;
+        }
+      }
+    }
+
+    _print("\r\nEnter the heartbeat period [seconds] (0: disabled, 10-65535):\r\n"
+           "[Press enter to leave current setting: ");
+    _print(hbPeriod);
+    _print("]\r\n\r\n");
+    long val;
+    do {
+      _print("> ");
+      _readEchoLine(5, false, false, &_betweenFilter, '0', '9');
+      if (_inBuffer[0] != '\0') {
+        val = atol(_inBuffer);
+      } else {
+        val = hbPeriod;
+      }
+    } while (val != 0 && (val < 10 || val > 65535));
+    hbPeriodNew = val;
+
+    _print("\r\nEnter the updates aggregation delay [milliseconds] (0-10000):\r\n"
+           "[Press enter to leave current setting: ");
+    _print(aggrDelay);
+    _print("]\r\n\r\n");
+    do {
+      _print("> ");
+      _readEchoLine(5, false, false, &_betweenFilter, '0', '9');
+      if (_inBuffer[0] != '\0') {
+        val = atol(_inBuffer);
+      } else {
+        val = aggrDelay;
+      }
+    } while (val > 10000);
+    aggrDelayNew = val;
+
+    _print("\r\nEnter the low-power receive windows period [seconds] (0: always receiving, 10-120):\r\n"
+           "[Press enter to leave current setting: ");
+    _print(rxPeriod);
+    _print("]\r\n\r\n");
+    do {
+      _print("> ");
+      _readEchoLine(3, false, false, &_betweenFilter, '0', '9');
+      if (_inBuffer[0] != '\0') {
+        val = atol(_inBuffer);
+      } else {
+        val = rxPeriod;
+      }
+    } while (val != 0 && (val < 10 || val > 120));
+    rxPeriodNew = val;
+
+    if (rxPeriodNew > 0) {
+      _print("\r\nEnter the receive window length [milliseconds] (100-10000):\r\n"
+             "[Press enter to leave current setting: ");
+      _print(rxWindow);
+      _print("]\r\n\r\n");
+      do {
+        _print("> ");
+        _readEchoLine(5, false, false, &_betweenFilter, '0', '9');
+        if (_inBuffer[0] != '\0') {
+          val = atol(_inBuffer);
+        } else {
+          val = rxWindow;
+        }
+      } while (val < 100 || val > 10000);
+      rxWindowNew = val;
+    }
   }
 
   _confirmConfiguration(addressNew, speedNew, parityNew,
     frequencyNew, txPowerNew, sfNew, dcNew, dcWinNew,
     siteIdNew, pwdNew, modesNew,
     inItvlNew[0], inItvlNew[1], inItvlNew[2], inItvlNew[3], inItvlNew[4], inItvlNew[5],
-    rulesNew, slavesAddrNew, slavesNumNew);
+    rulesNew, slavesAddrNew, slavesNumNew,
+    inDbNew, hbPeriodNew, aggrDelayNew,
+    groupsAddrNew, groupsUnitsNew,
+    peersFreqNew, peersNumNew,
+    channelsNew, channelsNumNew,
+    rxPeriodNew, rxWindowNew, maxAgeNew);
 }
 
 template <typename T>
@@ -802,7 +1416,6 @@ void SerialConfig::_readEchoLine(int maxLen, bool returnOnMaxLen,
           }
           break;
       }
-      delay(5);
     }
 
     for (; p < i; p++) {
@@ -819,101 +1432,127 @@ void SerialConfig::_readEchoLine(int maxLen, bool returnOnMaxLen,
   }
 }
 
-bool SerialConfig::_writeEepromConfig(byte address, byte speed, byte parity,
+bool SerialConfig::_writeConfig(byte address, byte speed, byte parity,
     uint32_t frequency, byte txPower, byte sf, uint16_t dc, uint16_t dcWin,
     byte *siteId, byte *pwd, char *modes,
     uint32_t inItvl1, uint32_t inItvl2, uint32_t inItvl3,
     uint32_t inItvl4, uint32_t inItvl5, uint32_t inItvl6,
-    char *rules, byte *slavesAddr, byte slavesNum) {
-  byte fb;
-  byte checksum = 7;
+    char *rules, byte *slavesAddr, byte slavesNum,
+    uint16_t *inDb, uint16_t hbPeriod, uint16_t aggrDelay,
+    byte *groupsAddr, byte (*groupsUnits)[32],
+    uint32_t *peersFreq, byte peersNum,
+    uint32_t *channels, byte channelsNum,
+    uint16_t rxPeriod, uint16_t rxWindow, uint16_t maxAge) {
+  ConfigData d;
+  memset(&d, 0, sizeof(ConfigData));
+  d.address = address;
+  d.speed = speed;
+  d.parity = parity;
+  d.txPower = txPower;
+  d.sf = sf;
+  d.frequency = frequency;
+  d.dc = dc;
+  d.dcWin = dcWin;
+  memcpy(d.siteId, siteId, 3);
+  memcpy(d.pwd, pwd, 16);
+  memcpy(d.modes, modes, 6);
+  d.inItvl[0] = inItvl1;
+  d.inItvl[1] = inItvl2;
+  d.inItvl[2] = inItvl3;
+  d.inItvl[3] = inItvl4;
+  d.inItvl[4] = inItvl5;
+  d.inItvl[5] = inItvl6;
+  memcpy(d.rules, rules, 4);
+  d.slavesNum = slavesNum;
+  memcpy(d.slavesAddr, slavesAddr, slavesNum);
+  memcpy(d.inDb, inDb, sizeof(d.inDb));
+  d.hbPeriod = hbPeriod;
+  d.aggrDelay = aggrDelay;
+  memcpy(d.groupsAddr, groupsAddr, sizeof(d.groupsAddr));
+  memcpy(d.groupsUnits, groupsUnits, sizeof(d.groupsUnits));
+  d.peersNum = peersNum;
+  memcpy(d.peersFreq, peersFreq, sizeof(uint32_t) * peersNum);
+  d.channelsNum = channelsNum;
+  memcpy(d.channels, channels, sizeof(uint32_t) * channelsNum);
+  d.rxPeriod = rxPeriod;
+  d.rxWindow = rxWindow;
+  d.maxAge = maxAge;
+
+  return ConfigStore.save(&d, sizeof(ConfigData), CONFIG_VERSION);
+}
 
-  EEPROM.write(0, address);
-  checksum ^= address;
-  EEPROM.write(1, speed);
-  checksum ^= speed;
-  EEPROM.write(2, parity);
-  checksum ^= parity;
-  for (int a = 0; a < 4; a++) {
-    fb = (byte) ((frequency >> (8 * a)) & 0xff);
-    EEPROM.write(a + 3, fb);
-    checksum ^= fb;
-  }
-  EEPROM.write(7, txPower);
-  checksum ^= txPower;
-  EEPROM.write(8, sf);
-  checksum ^= sf;
-  for (int a = 0; a < 2; a++) {
-    fb = (byte) ((dc >> (8 * a)) & 0xff);
-    EEPROM.write(a + 9, fb);
-    checksum ^= fb;
-  }
-  for (int a = 0; a < 2; a++) {
-    fb = (byte) ((dcWin >> (8 * a)) & 0xff);
-    EEPROM.write(a + 11, fb);
-    checksum ^= fb;
-  }
-  for (int a = 0; a < 3; a++) {
-    EEPROM.write(a + 13, siteId[a]);
-    checksum ^= siteId[a];
-  }
-  for (int a = 0; a < 16; a++) {
-    EEPROM.write(a + 16, pwd[a]);
-    checksum ^= pwd[a];
-  }
-  for (int a = 0; a < 6; a++) {
-    EEPROM.write(a + 32, modes[a]);
-    checksum ^= modes[a];
-  }
-  for (int a = 0; a < 2; a++) {
-    fb = (byte) ((inItvl1 >> (8 * a)) & 0xff);
-    EEPROM.write(a + 38, fb);
-    checksum ^= fb;
-  }
-  for (int a = 0; a < 2; a++) {
-    fb = (byte) ((inItvl2 >> (8 * a)) & 0xff);
-    EEPROM.write(a + 40, fb);
-    checksum ^= fb;
-  }
-  for (int a = 0; a < 2; a++) {
-    fb = (byte) ((inItvl3 >> (8 * a)) & 0xff);
-    EEPROM.write(a + 42, fb);
-    checksum ^= fb;
-  }
-  for (int a = 0; a < 2; a++) {
-    fb = (byte) ((inItvl4 >> (8 * a)) & 0xff);
-    EEPROM.write(a + 44, fb);
-    checksum ^= fb;
-  }
-  for (int a = 0; a < 2; a++) {
-    fb = (byte) ((inItvl5 >> (8 * a)) & 0xff);
-    EEPROM.write(a + 46, fb);
-    checksum ^= fb;
-  }
-  for (int a = 0; a < 2; a++) {
-    fb = (byte) ((inItvl6 >> (8 * a)) & 0xff);
-    EEPROM.write(a + 48, fb);
-    checksum ^= fb;
-  }
-  for (int a = 0; a < 4; a++) {
-    EEPROM.write(a + 50, rules[a]);
-    checksum ^= rules[a];
+/*
+  Loads the last saved configuration record. A configuration saved by a
+  previous version in the emulated EEPROM is migrated to a record.
+*/
+bool SerialConfig::_readConfig() {
+  ConfigData d;
+  // defaults of the fields missing in records of previous versions
+  memset(&d, 0, sizeof(ConfigData));
+  for (int i = 0; i < 4; i++) {
+    d.inDb[i] = DEFAULT_DEADBAND;
   }
-  EEPROM.write(54, slavesNum);
-  checksum ^= slavesNum;
+  d.rxWindow = RX_DEFAULT_WINDOW;
 
-  EEPROM.write(55, checksum);
-
-  for (int a = 0; a < slavesNum; a++) {
-    EEPROM.write(a + 56, slavesAddr[a]);
-    checksum ^= slavesAddr[a];
+  if (!ConfigStore.load(&d, sizeof(ConfigData))) {
+    if (!_readEepromConfig()) {
+      return false;
+    }
+    // if the save fails the migration is retried at the next start
+    _writeConfig(address, speed, parity,
+      frequency, txPower, sf, dc, dcWin,
+      siteId, pwd, modes,
+      inItvl[0], inItvl[1], inItvl[2], inItvl[3], inItvl[4], inItvl[5],
+      rules, slavesAddr, slavesNum,
+      inDb, hbPeriod, aggrDelay,
+      groupsAddr, groupsUnits,
+      peersFreq, peersNum,
+      channels, channelsNum,
+      rxPeriod, rxWindow, maxAge);
+    return true;
   }
 
-  EEPROM.commit();
+  address = d.address;
+  speed = d.speed;
+  parity = d.parity;
+  frequency = d.frequency;
+  txPower = d.txPower;
+  sf = d.sf;
+  dc = d.dc;
+  dcWin = d.dcWin;
+  memcpy(siteId, d.siteId, 3);
+  siteId[3] = '\0';
+  memcpy(pwd, d.pwd, 16);
+  pwd[16] = '\0';
+  memcpy(modes, d.modes, 6);
+  modes[6] = '\0';
+  for (int i = 0; i < 6; i++) {
+    inItvl[i] = d.inItvl[i];
+  }
+  memcpy(rules, d.rules, 4);
+  rules[4] = '\0';
+  slavesNum = min(d.slavesNum, (byte) MAX_SLAVES);
+  memcpy(slavesAddr, d.slavesAddr, slavesNum);
+  memcpy(inDb, d.inDb, sizeof(inDb));
+  hbPeriod = d.hbPeriod;
+  aggrDelay = d.aggrDelay;
+  memcpy(groupsAddr, d.groupsAddr, sizeof(groupsAddr));
+  memcpy(groupsUnits, d.groupsUnits, sizeof(groupsUnits));
+  peersNum = min(d.peersNum, (byte) MAX_PEERS);
+  memcpy(peersFreq, d.peersFreq, sizeof(uint32_t) * peersNum);
+  channelsNum = min(d.channelsNum, (byte) MAX_CHANNELS);
+  memcpy(channels, d.channels, sizeof(uint32_t) * channelsNum);
+  rxPeriod = d.rxPeriod;
+  rxWindow = d.rxWindow;
+  maxAge = d.maxAge;
 
   return true;
 }
 
+/*
+  Reads the configuration saved in the emulated EEPROM by previous
+  versions
+*/
 bool SerialConfig::_readEepromConfig() {
   if (!EEPROM.isValid()) {
     return false;
@@ -958,20 +1597,152 @@ bool SerialConfig::_readEepromConfig() {
   for (int a = 0; a < 4; a++) {
     rules[a] = mem[a + 50];
   }
-  slavesNum = mem[54];
+  slavesNum = min((byte) mem[54], (byte) MAX_SLAVES);
   for (int i = 0; i < slavesNum; i++) {
     slavesAddr[i] = EEPROM.read(56 + i);
   }
 
+  // fields added after the EEPROM versions
+  for (int i = 0; i < 4; i++) {
+    inDb[i] = DEFAULT_DEADBAND;
+  }
+  hbPeriod = 0;
+  aggrDelay = 0;
+  memset(groupsAddr, 0, sizeof(groupsAddr));
+  memset(groupsUnits, 0, sizeof(groupsUnits));
+
   return true;
 }
 
+/*
+  Returns the frequency [kHz] the unit operates on
+*/
+uint32_t SerialConfig::channel() {
+  return selectChannel(frequency, siteId, channels, channelsNum);
+}
+
+/*
+  With a channels list, the channel of the site is selected from the
+  list by the site ID, so that co-located sites spread over the channels
+*/
+uint32_t SerialConfig::selectChannel(uint32_t frequency, byte *siteId, uint32_t *channels, byte channelsNum) {
+  if (channelsNum == 0) {
+    return frequency;
+  }
+  return channels[ConfigStore.crc32(siteId, 3, 0) % channelsNum];
+}
+
+/*
+  Returns the duty cycle limit [1/1000] of the 863-870 MHz sub-band
+  including the channel, 1000 outside the band
+*/
+uint16_t SerialConfig::subBandDc(uint32_t frequency) {
+  int b = _subBand(frequency);
+  if (b >= 0) {
+    return SUB_BANDS[b][2];
+  }
+  return (frequency >= 863000 && frequency <= 870000) ? 1 : 1000;
+}
+
+/*
+  Returns the index in SUB_BANDS of the sub-band including the whole
+  channel, -1 if none
+*/
+int SerialConfig::_subBand(uint32_t frequency) {
+  int num = sizeof(SUB_BANDS) / sizeof(SUB_BANDS[0]);
+  for (int b = 0; b < num; b++) {
+    if (frequency - CHANNEL_HALF_BW >= SUB_BANDS[b][0]
+        && frequency + CHANNEL_HALF_BW <= SUB_BANDS[b][1]) {
+      return b;
+    }
+  }
+  return -1;
+}
+
+/*
+  A group address must be a valid Modbus address, other than the
+  gateway's, the listed remote units' and the other groups' ones
+*/
+bool SerialConfig::_validGroup(int g, int addr, byte address,
+    byte *slavesAddr, byte slavesNum, byte *groupsAddr) {
+  if (addr < 1 || addr > 247 || addr == address) {
+    return false;
+  }
+  for (int i = 0; i < slavesNum; i++) {
+    if (slavesAddr[i] == addr) {
+      return false;
+    }
+  }
+  for (int i = 0; i < MAX_GROUPS; i++) {
+    if (i != g && groupsAddr[i] == addr) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/*
+  The frequency [kHz] of another gateway must be a LoRa frequency, as
+  accepted for this gateway, and differ from this gateway's and the
+  other listed ones
+*/
+bool SerialConfig::_validPeer(uint32_t freq, uint32_t frequency, uint32_t *peersFreq, byte peersNum) {
+  if (freq < 400000l || freq == frequency) {
+    return false;
+  }
+  for (int i = 0; i < peersNum; i++) {
+    if (peersFreq[i] == freq) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/*
+  Prints a warning if the channel is not within a sub-band of the
+  863-870 MHz band, if the duty cycle exceeds the sub-band's limit, or if
+  the channel overlaps the channel of another gateway of the site
+*/
+void SerialConfig::_checkChannels(uint32_t frequency, uint16_t dc, uint32_t *peersFreq, byte peersNum) {
+  bool ok = true;
+  if (frequency >= 863000 && frequency <= 870000) {
+    int b = _subBand(frequency);
+    if (b < 0) {
+      _print("\r\nWarning: the channel is not within a sub-band of the 863-870 MHz band");
+      ok = false;
+    } else if (dc > SUB_BANDS[b][2]) {
+      _print("\r\nWarning: the duty cycle exceeds the sub-band's limit of ");
+      _print(SUB_BANDS[b][2] / 10.0);
+      _print("%, the limit will be applied");
+      ok = false;
+    }
+  }
+  for (int i = 0; i < peersNum; i++) {
+    if (frequency < peersFreq[i] + CHANNEL_SPACING && peersFreq[i] < frequency + CHANNEL_SPACING) {
+      _print("\r\nWarning: the channel is closer than ");
+      _print(CHANNEL_SPACING);
+      _print(" kHz to the gateway on ");
+      _print(peersFreq[i]);
+      ok = false;
+    }
+  }
+  if (ok) {
+    _print("\r\nChannel plan: OK");
+  }
+  _print("\r\n");
+}
+
 void SerialConfig::_confirmConfiguration(byte address, byte speed, byte parity,
     uint32_t frequency, byte txPower, byte sf, uint16_t dc, uint16_t dcWin,
     byte *siteId, byte *pwd, char *modes,
     uint32_t inItvl1, uint32_t inItvl2, uint32_t inItvl3,
     uint32_t inItvl4, uint32_t inItvl5, uint32_t inItvl6,
-    char *rules, byte *slavesAddr, byte slavesNum) {
+    char *rules, byte *slavesAddr, byte slavesNum,
+    uint16_t *inDb, uint16_t hbPeriod, uint16_t aggrDelay,
+    byte *groupsAddr, byte (*groupsUnits)[32],
+    uint32_t *peersFreq, byte peersNum,
+    uint32_t *channels, byte channelsNum,
+    uint16_t rxPeriod, uint16_t rxWindow, uint16_t maxAge) {
 
   _print("\r\nNew configuration:\r\n");
 
@@ -979,7 +1750,19 @@ void SerialConfig::_confirmConfiguration(byte address, byte speed, byte parity,
     frequency, txPower, sf, dc, dcWin,
     siteId, pwd, modes,
     inItvl1, inItvl2, inItvl3, inItvl4, inItvl5, inItvl6,
-    rules, slavesAddr, slavesNum);
+    rules, slavesAddr, slavesNum,
+    inDb, hbPeriod, aggrDelay,
+    groupsAddr, groupsUnits,
+    peersFreq, peersNum,
+    channels, channelsNum,
+    rxPeriod, rxWindow, maxAge);
+
+  if (channelsNum > 0) {
+    _print("Selected channel: ");
+    _print(selectChannel(frequency, siteId, channels, channelsNum));
+    _print("\r\n");
+  }
+  _checkChannels(selectChannel(frequency, siteId, channels, channelsNum), dc, peersFreq, peersNum);
 
   _print("\r\nConfirm? (Y/N):\r\n\r\n");
   do {
@@ -987,12 +1770,17 @@ void SerialConfig::_confirmConfiguration(byte address, byte speed, byte parity,
     _readEchoLine(1, false, true, &_orFilter, 'Y', 'N');
     if (_inBuffer[0] == 'Y') {
       _print("\r\nSaving...");
-      _writeEepromConfig(address, speed, parity,
+      bool saved = _writeConfig(address, speed, parity,
         frequency, txPower, sf, dc, dcWin,
         siteId, pwd, modes,
         inItvl1, inItvl2, inItvl3, inItvl4, inItvl5, inItvl6,
-        rules, slavesAddr, slavesNum);
-      if (_readEepromConfig()) {
+        rules, slavesAddr, slavesNum,
+        inDb, hbPeriod, aggrDelay,
+        groupsAddr, groupsUnits,
+        peersFreq, peersNum,
+        channels, channelsNum,
+        rxPeriod, rxWindow, maxAge);
+      if (saved && _readConfig()) {
         _print("\r\nSaved!\r\nResetting... bye!\r\n\r\n");
         delay(1000);
         NVIC_SystemReset();
@@ -1011,7 +1799,12 @@ void SerialConfig::_printConfiguration(byte address, byte speed, byte parity,
     byte *siteId, byte *pwd, char *modes,
     uint32_t inItvl1, uint32_t inItvl2, uint32_t inItvl3,
     uint32_t inItvl4, uint32_t inItvl5, uint32_t inItvl6,
-    char *rules, byte *slavesAddr, byte slavesNum) {
+    char *rules, byte *slavesAddr, byte slavesNum,
+    uint16_t *inDb, uint16_t hbPeriod, uint16_t aggrDelay,
+    byte *groupsAddr, byte (*groupsUnits)[32],
+    uint32_t *peersFreq, byte peersNum,
+    uint32_t *channels, byte channelsNum,
+    uint16_t rxPeriod, uint16_t rxWindow, uint16_t maxAge) {
 
   bool isGateway = (speed >= 1 && speed <= 8);
 
@@ -1029,6 +1822,15 @@ void SerialConfig::_printConfiguration(byte address, byte speed, byte parity,
   }
   _print("\r\nLoRa frequency: ");
   _print(frequency);
+  if (channelsNum > 0) {
+    _print("\r\nLoRa channels: ");
+    for (int i = 0; i < channelsNum; i++) {
+      if (i != 0) {
+        _print(", ");
+      }
+      _print(channels[i]);
+    }
+  }
   _print("\r\nLoRa TX power: ");
   _print(txPower);
   _print("\r\nLoRa spreading factor: ");
@@ -1072,6 +1874,39 @@ void SerialConfig::_printConfiguration(byte address, byte speed, byte parity,
     } else {
       _print("auto-discovery");
     }
+    for (int g = 0; g < MAX_GROUPS; g++) {
+      if (groupsAddr[g] == 0) {
+        continue;
+      }
+      _print("\r\nGroup ");
+      _print(g + 1);
+      _print(" address: ");
+      _print(groupsAddr[g]);
+      _print("\r\nGroup ");
+      _print(g + 1);
+      _print(" units: ");
+      bool first = true;
+      for (int a = 1; a <= 247; a++) {
+        if (groupsUnits[g][a / 8] & (1 << (a % 8))) {
+          if (!first) {
+            _print(", ");
+          }
+          _print(a);
+          first = false;
+        }
+      }
+    }
+    if (peersNum > 0) {
+      _print("\r\nOther gateways frequencies: ");
+      for (int i = 0; i < peersNum; i++) {
+        if (i != 0) {
+          _print(", ");
+        }
+        _print(peersFreq[i]);
+      }
+    }
+    _print("\r\nMax state age: ");
+    _print(maxAge);
   } else {
     if (modes[0] != '-') {
       _print("\r\nInput 1 updates interval: ");
@@ -1097,6 +1932,24 @@ void SerialConfig::_printConfiguration(byte address, byte speed, byte parity,
       _print("\r\nInput 6 updates interval: ");
       _print(inItvl6);
     }
+    for (int i = 0; i < 4; i++) {
+      if (modes[i] == 'V' || modes[i] == 'I') {
+        _print("\r\nInput ");
+        _print(i + 1);
+        _print(" deadband: ");
+        _print(inDb[i]);
+      }
+    }
+    _print("\r\nHeartbeat period: ");
+    _print(hbPeriod);
+    _print("\r\nAggregation delay: ");
+    _print(aggrDelay);
+    _print("\r\nReceive windows period: ");
+    _print(rxPeriod);
+    if (rxPeriod > 0) {
+      _print("\r\nReceive window length: ");
+      _print(rxWindow);
+    }
   }
   _print("\r\n");
 }
@@ -0,0 +1,103 @@
+/*
+  SiteClock.h
+
+    Copyright (C) 2018-2022 Sfera Labs S.r.l. - All rights reserved.
+
+    For information, see:
+    http://www.sferalabs.cc/
+
+  This code is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+  See file LICENSE.txt for further informations on licensing terms.
+*/
+
+#ifndef SiteClock_h
+#define SiteClock_h
+
+#define CLOCK_MIN_DRIFT_SPAN  600    // [s] min time between two settings to estimate the drift
+#define CLOCK_MAX_DRIFT       1000   // [ppm] larger estimates are discarded
+#define CLOCK_FOLD            86400  // [s] elapsed time folded into the reference
+
+/*
+  Site time, in seconds, kept by the gateway: set by the Modbus master
+  (e.g. to Unix time) and counted from the gateway start until then.
+  The drift of the local clock is estimated between two settings and
+  compensated.
+*/
+class SiteClock {
+  private:
+    static uint32_t _refTime;
+    static unsigned long _refMs;
+    static unsigned long _remMs;
+    static uint32_t _setTime;
+    static unsigned long _setMs;
+    static bool _set;
+
+    static unsigned long _elapsed(unsigned long ms);
+
+  public:
+    static long drift;
+
+    static void set(uint32_t time);
+    static uint32_t now();
+    static bool isSet();
+};
+
+uint32_t SiteClock::_refTime = 0;
+unsigned long SiteClock::_refMs = 0;
+unsigned long SiteClock::_remMs = 0;
+uint32_t SiteClock::_setTime;
+unsigned long SiteClock::_setMs;
+bool SiteClock::_set = false;
+long SiteClock::drift = 0;
+
+/*
+  Converts local milliseconds to site milliseconds, compensating the
+  drift [ppm]
+*/
+unsigned long SiteClock::_elapsed(unsigned long ms) {
+  return ms - (long) ((int64_t) ms * drift / 1000000);
+}
+
+void SiteClock::set(uint32_t time) {
+  unsigned long ms = millis();
+  if (_set && time > _setTime + CLOCK_MIN_DRIFT_SPAN) {
+    int64_t siteMs = (int64_t) (time - _setTime) * 1000;
+    int64_t localMs = (unsigned long) (ms - _setMs);
+    long d = (long) ((localMs - siteMs) * 1000000 / siteMs);
+    if (d > -CLOCK_MAX_DRIFT && d < CLOCK_MAX_DRIFT) {
+      drift = d;
+    }
+  }
+  if (!_set || time > _setTime + CLOCK_MIN_DRIFT_SPAN) {
+    _setTime = time;
+    _setMs = ms;
+  }
+  _set = true;
+  _refTime = time;
+  _refMs = ms;
+  _remMs = 0;
+}
+
+uint32_t SiteClock::now() {
+  unsigned long local = millis() - _refMs;
+  if (local >= CLOCK_FOLD * 1000ul) {
+    // keeps the elapsed time far from the millis() roll over
+    unsigned long site = _elapsed(local) + _remMs;
+    _refTime += site / 1000;
+    _remMs = site % 1000;
+    _refMs += local;
+    local = 0;
+  }
+  return _refTime + (_elapsed(local) + _remMs) / 1000;
+}
+
+bool SiteClock::isSet() {
+  return _set;
+}
+
+extern SiteClock SiteClock;
+
+#endif
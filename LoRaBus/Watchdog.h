@@ -16,17 +16,50 @@
 #ifndef Watchdog_h
 #define Watchdog_h
 
+#define WDT_NEAR  700  // [ms] gap between clears considered close to the timeout
+
 class Watchdog {
   private:
     static unsigned long _ts;
+    static unsigned long _clearTs;
+
+    static void _check();
 
   public:
+    static word near;
+
     static void setup();
     static void disable();
     static void clear();
+    static void idle(unsigned long ms);
 };
 
 unsigned long  Watchdog::_ts;
+unsigned long  Watchdog::_clearTs = 0;
+word Watchdog::near = 0;
+
+/*
+  Counts the calls to clear() spaced close to the watchdog timeout
+*/
+void Watchdog::_check() {
+  unsigned long now = millis();
+  if (_clearTs != 0 && now - _clearTs >= WDT_NEAR) {
+    near++;
+  }
+  _clearTs = now;
+}
+
+/*
+  Excludes the time [ms] the MCU idled, waiting for an interrupt, from
+  the gap between clears
+*/
+void Watchdog::idle(unsigned long ms) {
+  if (_clearTs != 0) {
+    _clearTs += ms;
+  }
+}
+
+#ifdef ARDUINO_ARCH_SAMD
 
 void Watchdog::disable() {
   REG_WDT_CTRL &= ~WDT_CTRL_ENABLE;
@@ -61,12 +94,31 @@ void Watchdog::setup() {
 }
 
 void Watchdog::clear() {
+  _check();
   if (!WDT->STATUS.bit.SYNCBUSY && millis() - _ts >= 300) {
     REG_WDT_CLEAR = WDT_CLEAR_CLEAR_KEY;
     _ts = millis();
   }
 }
 
+#else
+
+// No watchdog on other architectures (e.g. when building off-target)
+
+void Watchdog::disable() {
+}
+
+void Watchdog::setup() {
+  _ts = millis();
+}
+
+void Watchdog::clear() {
+  _check();
+  _ts = millis();
+}
+
+#endif
+
 extern Watchdog Watchdog;
 
 #endif
@@ -0,0 +1,185 @@
+/*
+  Harness.h - drives the LoRaBus sketch in the host tests
+
+    Copyright (C) 2018-2022 Sfera Labs S.r.l. - All rights reserved.
+
+    For information, see:
+    http://www.sferalabs.cc/
+
+  This code is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+  See file LICENSE.txt for further informations on licensing terms.
+*/
+
+#ifndef Harness_h
+#define Harness_h
+
+#include "Sim.h"
+
+/*
+  Included by a test after the sketch (LoRaBus.cpp), one sketch per test
+  executable
+*/
+
+static int _failures = 0;
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+      fprintf(stderr, "%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, #cond); \
+      _failures++; \
+    } \
+  } while (0)
+
+#define CHECK_EQ(a, b) do { \
+    long long _a = (long long) (a); \
+    long long _b = (long long) (b); \
+    if (_a != _b) { \
+      fprintf(stderr, "%s:%d: CHECK failed: %s == %s (%lld != %lld)\n", \
+          __FILE__, __LINE__, #a, #b, _a, _b); \
+      _failures++; \
+    } \
+  } while (0)
+
+#define TEST_RESULT() (fprintf(stderr, _failures == 0 ? "OK\n" : "%d failures\n", _failures), \
+    _failures == 0 ? 0 : 1)
+
+#define NO_RESPONSE -1000
+
+namespace harness {
+
+/*
+  Runs one loop() iteration and the simulated devices, then advances
+  the clock by the loop duration
+*/
+inline void step() {
+  loop();
+  sim::processNodes();
+  sim::advance(sim::loopUs);
+}
+
+inline void run(unsigned long ms) {
+  unsigned long long end = sim::nowUs + ms * 1000ull;
+  while (sim::nowUs < end) {
+    step();
+  }
+}
+
+template<class F>
+inline bool runUntil(F cond, unsigned long timeoutMs) {
+  unsigned long long end = sim::nowUs + timeoutMs * 1000ull;
+  while (!cond()) {
+    if (sim::nowUs >= end) {
+      return false;
+    }
+    step();
+  }
+  return true;
+}
+
+/*
+  Boots the sketch with the configuration found in flash, then runs it
+  until the console is closed
+*/
+inline void start() {
+  setup();
+  runUntil([]() { return !SerialConfig.isAvailable; }, CONSOLE_TIMEOUT + 1000);
+}
+
+// console output of the last boot()
+static std::string console;
+
+/*
+  Boots the sketch with the configuration imported through the console,
+  as pasted by a user, then runs it until the console is closed.
+  Returns false if the configuration is rejected.
+*/
+inline bool boot(const char *config) {
+  Serial.input("     ");
+  Serial.input("2\r\n", 200);
+  Serial.input(config, 400);
+  Serial.input("\r\nY\r\n", 2000);
+  try {
+    setup();
+  } catch (sim::Reset &) {
+  } catch (sim::InputExhausted &) {
+    // back to the menu
+    console = Serial.output;
+    Serial.clear();
+    return false;
+  }
+  console = Serial.output;
+  Serial.clear();
+  start();
+  return true;
+}
+
+/*
+  Sends a Modbus RTU request on the bus and runs the sketch until it
+  responds. Returns the response without the CRC, empty if none within
+  the timeout. latencyUs is the time from the end of the request to the
+  end of the response.
+*/
+inline std::vector<uint8_t> request(const std::vector<uint8_t> &pdu,
+    unsigned long timeoutMs = 1000, unsigned long *latencyUs = NULL) {
+  unsigned long responses = sim::bus.responses;
+  sim::bus.send(sim::rtuFrame(pdu));
+  unsigned long long sentTs = sim::bus.toSlave.back().first;
+  if (!runUntil([&]() { return sim::bus.responses != responses; }, timeoutMs)) {
+    return std::vector<uint8_t>();
+  }
+  if (latencyUs != NULL) {
+    *latencyUs = sim::bus.responseTs - sentTs;
+  }
+  std::vector<uint8_t> res = sim::bus.response;
+  res.resize(res.size() - 2);
+  return res;
+}
+
+inline std::vector<uint8_t> pdu(byte unit, byte function, word addr, word value) {
+  std::vector<uint8_t> p;
+  p.push_back(unit);
+  p.push_back(function);
+  p.push_back(addr >> 8);
+  p.push_back(addr & 0xFF);
+  p.push_back(value >> 8);
+  p.push_back(value & 0xFF);
+  return p;
+}
+
+/*
+  Returns the value of one register or coil, minus the exception code,
+  or NO_RESPONSE
+*/
+inline long read(byte unit, byte function, word addr) {
+  std::vector<uint8_t> res = request(pdu(unit, function, addr, 1));
+  if (res.empty()) {
+    return NO_RESPONSE;
+  }
+  if (res[1] & 0x80) {
+    return -res[2];
+  }
+  if (function <= MB_FC_READ_DISCRETE_INPUTS) {
+    return res[3] & 1;
+  }
+  return (res[3] << 8) | res[4];
+}
+
+/*
+  Returns 0 if acknowledged, minus the exception code or NO_RESPONSE
+*/
+inline long write(byte unit, byte function, word addr, word value) {
+  if (function == MB_FC_WRITE_SINGLE_COIL) {
+    value = value ? 0xFF00 : 0;
+  }
+  std::vector<uint8_t> res = request(pdu(unit, function, addr, value));
+  if (res.empty()) {
+    return NO_RESPONSE;
+  }
+  return (res[1] & 0x80) ? -res[2] : 0;
+}
+
+}
+
+#endif
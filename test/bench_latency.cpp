@@ -0,0 +1,193 @@
+/*
+  End-to-end benchmarks of the gateway on the simulated bus and channel:
+  Modbus poll-to-response latency per function code, write-to-relay
+  latency, state updates throughput from 1 to MAX_SLAVES remote units and
+  loop() execution time. Times are simulated, except the loop's host
+  time. Prints one JSON object per measurement.
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include "LoRaBus.cpp"
+#include "Harness.h"
+
+using namespace harness;
+
+const unsigned long UPDATE_PERIOD = 10000;  // [ms] heartbeat of the simulated units
+const int REQUESTS = 200;
+
+std::string config() {
+  std::string units;
+  for (int a = 2; a < MAX_SLAVES + 2; a++) {
+    units += (a > 2 ? ", " : "") + std::to_string(a);
+  }
+  return "[GATEWAY]\r\n"
+    "Unit address: 1\r\n"
+    "LoRa frequency: 869500\r\n"
+    "LoRa TX power: 14\r\n"
+    "LoRa spreading factor: 7\r\n"
+    "LoRa duty cycle: 10.00\r\n"
+    "LoRa duty cycle window: 3600\r\n"
+    "Site ID: abc\r\n"
+    "Password: 16AsciiCharsPwrd\r\n"
+    "Input modes: DDVI-D\r\n"
+    "I/O rules: ----\r\n"
+    "Serial speed: 19200\r\n"
+    "Serial parity: Even\r\n"
+    "Remote units: " + units + "\r\n";
+}
+
+template<class T>
+T percentile(std::vector<T> v, int p) {
+  std::sort(v.begin(), v.end());
+  return v[min(v.size() - 1, v.size() * p / 100)];
+}
+
+/*
+  Units 2 to n+1 sending their state every UPDATE_PERIOD, each with a
+  random phase
+*/
+std::vector<std::unique_ptr<sim::Unit> > startUnits(int n) {
+  std::vector<unsigned long> phases;
+  for (int i = 0; i < n; i++) {
+    phases.push_back(sim::rand32() % UPDATE_PERIOD);
+  }
+  std::sort(phases.begin(), phases.end());
+  std::vector<std::unique_ptr<sim::Unit> > units;
+  unsigned long elapsed = 0;
+  for (int i = 0; i < n; i++) {
+    run(phases[i] - elapsed);
+    elapsed = phases[i];
+    units.emplace_back(new sim::Unit(i + 2, 869500));
+    units.back()->heartbeatMs = UPDATE_PERIOD;
+    units.back()->report();
+  }
+  run(UPDATE_PERIOD - elapsed);
+  return units;
+}
+
+std::vector<uint8_t> writeMultiple(byte unit, byte function, word addr, word value) {
+  std::vector<uint8_t> p = pdu(unit, function, addr, 1);
+  if (function == MB_FC_WRITE_MULTIPLE_COILS) {
+    p.push_back(1);
+    p.push_back(value & 1);
+  } else {
+    p.push_back(2);
+    p.push_back(value >> 8);
+    p.push_back(value & 0xFF);
+  }
+  return p;
+}
+
+void benchModbus() {
+  struct { byte function; word addr; } polls[] = {
+    {MB_FC_READ_COILS, 1},
+    {MB_FC_READ_DISCRETE_INPUTS, 101},
+    {MB_FC_READ_HOLDING_REGISTERS, 601},
+    {MB_FC_READ_INPUT_REGISTER, 201},
+    {MB_FC_WRITE_SINGLE_COIL, 1},
+    {MB_FC_WRITE_SINGLE_REGISTER, 601},
+    {MB_FC_WRITE_MULTIPLE_COILS, 1},
+    {MB_FC_WRITE_MULTIPLE_REGISTERS, 601},
+  };
+  // polls while 16 units keep sending their updates
+  std::vector<std::unique_ptr<sim::Unit> > units = startUnits(16);
+  for (auto &poll : polls) {
+    std::vector<unsigned long> latencies;
+    for (int i = 0; i < REQUESTS; i++) {
+      byte unit = 2 + i % 16;
+      word value = i % 2 ? (poll.addr == 601 ? 5000 : 0xFF00) : 0;
+      std::vector<uint8_t> req;
+      if (poll.function == MB_FC_WRITE_MULTIPLE_COILS || poll.function == MB_FC_WRITE_MULTIPLE_REGISTERS) {
+        req = writeMultiple(unit, poll.function, poll.addr, value);
+      } else if (poll.function >= MB_FC_WRITE_SINGLE_COIL) {
+        req = pdu(unit, poll.function, poll.addr, value);
+      } else {
+        req = pdu(unit, poll.function, poll.addr, 1);
+      }
+      unsigned long latencyUs;
+      std::vector<uint8_t> res = request(req, 1000, &latencyUs);
+      CHECK(!res.empty() && (res[1] & 0x80) == 0);
+      latencies.push_back(latencyUs);
+      run(sim::rand32() % 50);
+    }
+    printf("{\"bench\": \"modbus\", \"function\": %u, \"requests\": %d, \"p50_us\": %lu, \"p99_us\": %lu}\n",
+        poll.function, REQUESTS, percentile(latencies, 50), percentile(latencies, 99));
+  }
+  run(5000);
+}
+
+void benchWriteToRelay() {
+  sim::Unit unit(2, 869500);
+  unit.report();
+  run(400);
+  std::vector<unsigned long> latencies;
+  for (int i = 0; i < 30; i++) {
+    int on = (i + 1) % 2;
+    unsigned long long sentUs = sim::nowUs;
+    CHECK_EQ(write(2, MB_FC_WRITE_SINGLE_COIL, 1, on), 0);
+    CHECK(runUntil([&]() { return unit.state.get(DO1) == on; }, 5000));
+    latencies.push_back((sim::nowUs - sentUs) / 1000);
+    run(500 + sim::rand32() % 500);
+  }
+  printf("{\"bench\": \"write_to_relay\", \"writes\": %d, \"p50_ms\": %lu, \"p99_ms\": %lu}\n",
+      (int) latencies.size(), percentile(latencies, 50), percentile(latencies, 99));
+}
+
+void benchThroughput() {
+  // coarser loop steps to keep the simulated minutes short, the radio
+  // reception does not depend on them
+  unsigned long loopUs = sim::loopUs;
+  sim::loopUs = 1000;
+  const int COUNTS[] = {1, 8, 16, 32, MAX_SLAVES};
+  for (int n : COUNTS) {
+    std::vector<std::unique_ptr<sim::Unit> > units = startUnits(n);
+    unsigned long sent = 0;
+    for (auto &u : units) {
+      sent -= u->radio.txFrames;
+    }
+    unsigned long received = LoRa.radio.rxFrames;
+    const unsigned long duration = 3 * UPDATE_PERIOD;
+    run(duration);
+    for (auto &u : units) {
+      sent += u->radio.txFrames;
+    }
+    received = LoRa.radio.rxFrames - received;
+    CHECK(received > 0 && received <= sent);
+    // fraction of the time the channel is busy with the offered updates
+    double load = sent * (double) sim::timeOnAirUs(7, sim::encodeState(2, units[0]->state).size())
+        / (duration * 1000.0);
+    printf("{\"bench\": \"throughput\", \"units\": %d, \"channel_load\": %.2f, "
+        "\"offered_per_s\": %.2f, \"received_per_s\": %.2f}\n",
+        n, load, sent * 1000.0 / duration, received * 1000.0 / duration);
+  }
+  sim::loopUs = loopUs;
+}
+
+void benchLoop() {
+  std::vector<std::unique_ptr<sim::Unit> > units = startUnits(16);
+  std::vector<double> hostNs;
+  unsigned long long simUsMax = 0;
+  for (int i = 0; i < 100000; i++) {
+    unsigned long long simStart = sim::nowUs;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    loop();
+    hostNs.push_back(std::chrono::duration<double, std::nano>(
+        std::chrono::steady_clock::now() - start).count());
+    simUsMax = max(simUsMax, sim::nowUs - simStart);
+    sim::processNodes();
+    sim::advance(sim::loopUs);
+  }
+  printf("{\"bench\": \"loop\", \"iterations\": %d, \"host_p50_ns\": %.0f, \"host_p99_ns\": %.0f, \"sim_max_us\": %llu}\n",
+      (int) hostNs.size(), percentile(hostNs, 50), percentile(hostNs, 99), simUsMax);
+}
+
+int main() {
+  CHECK(boot(config().c_str()));
+  benchModbus();
+  benchWriteToRelay();
+  benchThroughput();
+  benchLoop();
+  return TEST_RESULT();
+}
@@ -0,0 +1,97 @@
+/*
+  Remote unit lookup of the Modbus handler: the address index against
+  the linear scan of the slaves buffer it replaced, from 1 to MAX_SLAVES
+  configured units, on a bus where most requests are for other devices.
+  Prints one JSON object per units count. A unit re-addressed after being
+  indexed is found at its new address.
+*/
+
+#include <chrono>
+#include "LoRaBus.cpp"
+#include "Harness.h"
+
+using namespace harness;
+
+const char *CONFIG =
+  "[GATEWAY]\r\n"
+  "Unit address: 1\r\n"
+  "LoRa frequency: 869500\r\n"
+  "LoRa TX power: 14\r\n"
+  "LoRa spreading factor: 7\r\n"
+  "LoRa duty cycle: 1.00\r\n"
+  "LoRa duty cycle window: 3600\r\n"
+  "Site ID: abc\r\n"
+  "Password: 16AsciiCharsPwrd\r\n"
+  "Input modes: DDVI-D\r\n"
+  "I/O rules: ----\r\n"
+  "Serial speed: 19200\r\n"
+  "Serial parity: Even\r\n"
+  "Remote units: 2\r\n";
+
+const int LOOKUPS = 1000000;
+
+// the lookup before the index
+IonoLoRaRemoteSlave *scanSlaves(byte unitAddr) {
+  for (int i = 0; i < slavesMax; i++) {
+    if (slavesRefsBuffer[i]->getAddr() == unitAddr) {
+      return (IonoLoRaRemoteSlave *) slavesRefsBuffer[i];
+    }
+  }
+  return NULL;
+}
+
+// keeps the lookups from being optimized out
+volatile uintptr_t sink;
+
+template<class F>
+double nsPerLookup(F find, const std::vector<byte> &addrs) {
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  for (int i = 0; i < LOOKUPS; i++) {
+    sink = sink + (uintptr_t) find(addrs[i % addrs.size()]);
+  }
+  return std::chrono::duration<double, std::nano>(
+      std::chrono::steady_clock::now() - start).count() / LOOKUPS;
+}
+
+int main() {
+  CHECK(boot(CONFIG));
+
+  // requests for any address, units at 2 to n+1
+  std::vector<byte> addrs;
+  for (int i = 0; i < 4096; i++) {
+    addrs.push_back(1 + sim::rand32() % 247);
+  }
+
+  const int COUNTS[] = {1, 8, 16, 32, MAX_SLAVES};
+  double scanNs = 0;
+  double indexNs = 0;
+  for (int n : COUNTS) {
+    slavesMax = n;
+    for (int i = 0; i < n; i++) {
+      slavesRefsBuffer[i] = &slavesBuffer[i];
+      slavesRefsBuffer[i]->setAddr(i + 2);
+    }
+    loRaMaster.setSlaves(slavesRefsBuffer, n);
+    clearSlavesIndex();
+    indexSlaves();
+
+    for (int a = 0; a < 256; a++) {
+      CHECK(findSlave(a) == scanSlaves(a));
+    }
+
+    scanNs = nsPerLookup(&scanSlaves, addrs);
+    indexNs = nsPerLookup(&findSlave, addrs);
+    printf("{\"slaves\": %d, \"scan_ns\": %.2f, \"index_ns\": %.2f}\n", n, scanNs, indexNs);
+  }
+  CHECK(indexNs < scanNs);
+
+  // a unit re-addressed after being indexed is found at its new address
+  // from the next loop
+  slavesRefsBuffer[3]->setAddr(200);
+  step();
+  CHECK(findSlave(200) == &slavesBuffer[3]);
+  CHECK(findSlave(5) == NULL);
+  CHECK(findSlave(6) == &slavesBuffer[4]);
+
+  return TEST_RESULT();
+}
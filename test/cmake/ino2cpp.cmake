@@ -0,0 +1,33 @@
+# Turns an Arduino sketch into a C++ translation unit as the Arduino
+# builder does: Arduino.h is included first and the prototypes of the
+# sketch's functions are inserted before the first function definition.
+#
+#   cmake -DINO=<sketch.ino> -DOUT=<sketch.cpp> -P ino2cpp.cmake
+
+file(READ "${INO}" src)
+
+# function definitions start at the beginning of a line
+set(def_re "\n[A-Za-z_][A-Za-z0-9_ ]*[ *]+[A-Za-z_][A-Za-z0-9_]*\\([^;{}()]*\\)[ ]*[{]")
+string(REGEX MATCHALL "${def_re}" defs "${src}")
+list(LENGTH defs defs_num)
+if(defs_num EQUAL 0)
+  message(FATAL_ERROR "No function definitions found in ${INO}")
+endif()
+
+set(protos "")
+foreach(def IN LISTS defs)
+  string(REGEX REPLACE "^\n" "" def "${def}")
+  string(REGEX REPLACE "[ ]*[{]$" "" def "${def}")
+  string(APPEND protos "${def};\n")
+endforeach()
+
+list(GET defs 0 first)
+string(FIND "${src}" "${first}" pos)
+string(SUBSTRING "${src}" 0 ${pos} head)
+string(SUBSTRING "${src}" ${pos} -1 tail)
+string(REGEX MATCHALL "\n" newlines "${head}")
+list(LENGTH newlines line)
+math(EXPR line "${line} + 1")
+
+file(WRITE "${OUT}"
+  "#include <Arduino.h>\n#line 1 \"${INO}\"\n${head}\n${protos}#line ${line} \"${INO}\"${tail}")
@@ -0,0 +1,143 @@
+/*
+  Arduino.h - host stub of the Arduino core for the LoRaBus tests
+
+    Copyright (C) 2018-2022 Sfera Labs S.r.l. - All rights reserved.
+
+    For information, see:
+    http://www.sferalabs.cc/
+
+  This code is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+  See file LICENSE.txt for further informations on licensing terms.
+*/
+
+#ifndef Arduino_h
+#define Arduino_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+// standard headers used by the tests, before the min/max macros
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+typedef uint8_t byte;
+typedef uint16_t word;
+typedef bool boolean;
+
+#define HIGH 1
+#define LOW  0
+
+#define DEC 10
+#define HEX 16
+
+#define PIN_TXEN 5
+
+#define SERIAL_8N1 0x13
+#define SERIAL_8E1 0x12
+#define SERIAL_8O1 0x11
+#define SERIAL_8N2 0x33
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+long random(long max);
+long random(long min, long max);
+void randomSeed(unsigned long seed);
+void pinMode(int pin, int mode);
+void digitalWrite(int pin, int value);
+void NVIC_SystemReset();
+
+class Print {
+  public:
+    virtual ~Print() {}
+    virtual size_t write(uint8_t c) = 0;
+    size_t write(const char *str);
+    size_t print(const char *str);
+    size_t print(char c);
+    size_t print(unsigned char n, int base = DEC);
+    size_t print(int n, int base = DEC);
+    size_t print(unsigned int n, int base = DEC);
+    size_t print(long n, int base = DEC);
+    size_t print(unsigned long n, int base = DEC);
+    size_t print(double n, int digits = 2);
+    size_t println(const char *str);
+};
+
+class Stream : public Print {
+  protected:
+    unsigned long _timeout = 1000;
+
+    virtual int timedRead();
+
+  public:
+    virtual int available() = 0;
+    virtual int read() = 0;
+    virtual int peek() = 0;
+    virtual void flush() {}
+    void setTimeout(unsigned long timeout);
+    size_t readBytes(char *buffer, size_t length);
+    size_t readBytes(uint8_t *buffer, size_t length);
+};
+
+/*
+  Serial port fed by the tests: each chunk of input becomes available
+  at its time, the output is collected in a string
+*/
+class Uart : public Stream {
+  private:
+    struct Chunk {
+      unsigned long long ts;
+      std::string data;
+    };
+    std::deque<Chunk> _input;
+    unsigned long _spins = 0;
+    unsigned long long _spinTs = 0;
+
+    bool _ready();
+    int timedRead() override;
+
+  public:
+    std::string output;
+    bool open = false;
+
+    void begin(unsigned long baud, uint16_t config = SERIAL_8N1);
+    void end();
+    int available() override;
+    int read() override;
+    int peek() override;
+    size_t write(uint8_t c) override;
+    using Print::write;
+
+    // host side
+    void input(const char *data, unsigned long delayMs = 0);
+    bool pending();
+    void clear();
+};
+
+extern Uart Serial;
+extern Uart Serial1;
+
+#define SERIAL_PORT_MONITOR  Serial
+#define SERIAL_PORT_HARDWARE Serial1
+
+#ifndef min
+#define min(a, b) ((a) < (b) ? (a) : (b))
+#endif
+#ifndef max
+#define max(a, b) ((a) > (b) ? (a) : (b))
+#endif
+
+#endif
@@ -0,0 +1,19 @@
+/*
+  FlashAsEEPROM.cpp - host stub of the FlashStorage EEPROM emulation for
+  the LoRaBus tests
+
+    Copyright (C) 2018-2022 Sfera Labs S.r.l. - All rights reserved.
+
+    For information, see:
+    http://www.sferalabs.cc/
+
+  This code is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+  See file LICENSE.txt for further informations on licensing terms.
+*/
+
+#include "FlashAsEEPROM.h"
+
+EEPROMClass EEPROM;
@@ -0,0 +1,37 @@
+/*
+  FlashAsEEPROM.h - host stub of the FlashStorage EEPROM emulation for
+  the LoRaBus tests
+
+    Copyright (C) 2018-2022 Sfera Labs S.r.l. - All rights reserved.
+
+    For information, see:
+    http://www.sferalabs.cc/
+
+  This code is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+  See file LICENSE.txt for further informations on licensing terms.
+*/
+
+#ifndef FlashAsEEPROM_h
+#define FlashAsEEPROM_h
+
+#include "Arduino.h"
+
+#define EEPROM_EMULATION_SIZE 1024
+
+class EEPROMClass {
+  public:
+    uint8_t data[EEPROM_EMULATION_SIZE] = {};
+    bool valid = false;
+
+    uint8_t read(int address) { return data[address]; }
+    void write(int address, uint8_t value) { data[address] = value; }
+    void commit() { valid = true; }
+    bool isValid() { return valid; }
+};
+
+extern EEPROMClass EEPROM;
+
+#endif
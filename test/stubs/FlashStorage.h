@@ -0,0 +1,49 @@
+/*
+  FlashStorage.h - host stub of the FlashStorage library for the LoRaBus
+  tests
+
+    Copyright (C) 2018-2022 Sfera Labs S.r.l. - All rights reserved.
+
+    For information, see:
+    http://www.sferalabs.cc/
+
+  This code is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+  See file LICENSE.txt for further informations on licensing terms.
+*/
+
+#ifndef FlashStorage_h
+#define FlashStorage_h
+
+#include "Arduino.h"
+#include "Sim.h"
+
+/*
+  Flash area in RAM, zeroed as in a freshly uploaded sketch. Writes take
+  the flash row time and can be cut by a simulated power loss.
+*/
+template<class T>
+class FlashStorageClass {
+  public:
+    uint8_t bytes[sizeof(T)] = {};
+
+    void read(T *data) {
+      memcpy((void *) data, bytes, sizeof(T));
+    }
+
+    T read() {
+      T data;
+      read(&data);
+      return data;
+    }
+
+    void write(T data) {
+      sim::flashWrite(bytes, &data, sizeof(T));
+    }
+};
+
+#define FlashStorage(name, T) FlashStorageClass<T> name
+
+#endif
@@ -0,0 +1,88 @@
+/*
+  Iono.cpp - host stub of the Iono library for the LoRaBus tests
+
+    Copyright (C) 2018-2022 Sfera Labs S.r.l. - All rights reserved.
+
+    For information, see:
+    http://www.sferalabs.cc/
+
+  This code is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+  See file LICENSE.txt for further informations on licensing terms.
+*/
+
+#include "Iono.h"
+
+IonoClass Iono;
+
+IonoClass::IonoClass() {
+  for (int i = 0; i < IONO_PINS; i++) {
+    _pins[i] = 0;
+  }
+  for (int i = 0; i < 6; i++) {
+    _counts[i] = 0;
+  }
+}
+
+void IonoClass::subscribeDigital(uint8_t pin, unsigned long stableTime, void (*callback)(uint8_t, float)) {
+  subscribeAnalog(pin, stableTime, 0, callback);
+}
+
+void IonoClass::subscribeAnalog(uint8_t pin, unsigned long stableTime, float minVariation, void (*callback)(uint8_t, float)) {
+  Subscription s;
+  s.pin = pin;
+  s.stableTime = stableTime;
+  s.minVariation = minVariation;
+  s.callback = callback;
+  s.notified = -1;
+  s.candidate = read(pin);
+  s.candidateTs = millis();
+  _subs.push_back(s);
+}
+
+void IonoClass::linkDiDo(uint8_t dix, uint8_t dox, uint8_t mode, unsigned long stableTime) {
+}
+
+void IonoClass::process() {
+  for (Subscription &s : _subs) {
+    float v = read(s.pin);
+    if (v != s.candidate) {
+      s.candidate = v;
+      s.candidateTs = millis();
+    }
+    if (millis() - s.candidateTs < s.stableTime || v == s.notified) {
+      continue;
+    }
+    if (s.notified >= 0 && s.minVariation > 0 && fabs(v - s.notified) < s.minVariation) {
+      continue;
+    }
+    s.notified = v;
+    s.callback(s.pin, v);
+  }
+}
+
+float IonoClass::read(uint8_t pin) {
+  return pin < IONO_PINS ? _pins[pin] : -1;
+}
+
+void IonoClass::write(uint8_t pin, float value) {
+  if (pin >= DO1 && pin <= DO6) {
+    value = value != 0 ? HIGH : LOW;
+  }
+  if (pin < IONO_PINS) {
+    _pins[pin] = value;
+  }
+}
+
+void IonoClass::set(uint8_t pin, float value) {
+  if (pin >= DI1 && pin <= DI6 && value != 0 && _pins[pin] == 0) {
+    _counts[pin - DI1]++;
+  }
+  write(pin, value);
+}
+
+word IonoClass::count(uint8_t pin) {
+  return (pin >= DI1 && pin <= DI6) ? _counts[pin - DI1] : 0;
+}
@@ -0,0 +1,87 @@
+/*
+  Iono.h - host stub of the Iono library for the LoRaBus tests
+
+    Copyright (C) 2018-2022 Sfera Labs S.r.l. - All rights reserved.
+
+    For information, see:
+    http://www.sferalabs.cc/
+
+  This code is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+  See file LICENSE.txt for further informations on licensing terms.
+*/
+
+#ifndef Iono_h
+#define Iono_h
+
+#include "Arduino.h"
+
+#define DO1 1
+#define DO2 2
+#define DO3 3
+#define DO4 4
+#define DO5 5
+#define DO6 6
+#define DI1 7
+#define DI2 8
+#define DI3 9
+#define DI4 10
+#define DI5 11
+#define DI6 12
+#define AV1 13
+#define AV2 14
+#define AV3 15
+#define AV4 16
+#define AI1 17
+#define AI2 18
+#define AI3 19
+#define AI4 20
+#define AO1 21
+
+#define LINK_FOLLOW 1
+#define LINK_INVERT 2
+#define LINK_FLIP_T 3
+#define LINK_FLIP_H 4
+#define LINK_FLIP_L 5
+
+#define IONO_PINS 22
+
+/*
+  Pins are set by the tests; subscriptions notify a value once it has
+  been stable for the subscription's time and, for analog pins, moved
+  by at least the minimum variation from the last notified value
+*/
+class IonoClass {
+  private:
+    struct Subscription {
+      uint8_t pin;
+      unsigned long stableTime;
+      float minVariation;
+      void (*callback)(uint8_t, float);
+      float notified;
+      float candidate;
+      unsigned long candidateTs;
+    };
+    std::vector<Subscription> _subs;
+    float _pins[IONO_PINS];
+    word _counts[6];
+
+  public:
+    IonoClass();
+    void subscribeDigital(uint8_t pin, unsigned long stableTime, void (*callback)(uint8_t, float));
+    void subscribeAnalog(uint8_t pin, unsigned long stableTime, float minVariation, void (*callback)(uint8_t, float));
+    void linkDiDo(uint8_t dix, uint8_t dox, uint8_t mode, unsigned long stableTime);
+    void process();
+    float read(uint8_t pin);
+    void write(uint8_t pin, float value);
+
+    // host side
+    void set(uint8_t pin, float value);
+    word count(uint8_t pin);
+};
+
+extern IonoClass Iono;
+
+#endif
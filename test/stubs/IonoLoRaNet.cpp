@@ -0,0 +1,185 @@
+/*
+  IonoLoRaNet.cpp - host stub of the Iono MKR LoRaNet library for the
+  LoRaBus tests
+
+    Copyright (C) 2018-2022 Sfera Labs S.r.l. - All rights reserved.
+
+    For information, see:
+    http://www.sferalabs.cc/
+
+  This code is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+  See file LICENSE.txt for further informations on licensing terms.
+*/
+
+#include "IonoLoRaNet.h"
+
+LoRaClass LoRa;
+LoRaNetClass LoRaNet;
+
+void LoRaNetClass::init(byte *siteId, int siteIdLen, byte *pwd) {
+  memcpy(sim::siteId, siteId, min(siteIdLen, 3));
+}
+
+/*
+  window in seconds, dc in 1/1000
+*/
+void LoRaNetClass::setDutyCycle(uint16_t window, uint16_t dc) {
+  _winUs = window * 1000000ull;
+  _budgetUs = window * (unsigned long long) dc * 1000ull;
+  _usedUs = 0;
+  _winStart = sim::nowUs;
+}
+
+bool LoRaNetClass::transmit(const std::vector<uint8_t> &frame) {
+  if (_winUs > 0 && sim::nowUs - _winStart >= _winUs) {
+    _winStart += ((sim::nowUs - _winStart) / _winUs) * _winUs;
+    _usedUs = 0;
+  }
+  unsigned long long toa = sim::timeOnAirUs(LoRa.radio.sf, frame.size());
+  if (_winUs > 0 && _usedUs + toa > _budgetUs) {
+    held++;
+    return false;
+  }
+  _usedUs += toa;
+  LoRa.radio.transmit(frame);
+  sent++;
+  return true;
+}
+
+float IonoLoRaRemoteSlave::read(uint8_t pin) {
+  if (!hasState) {
+    return -1;
+  }
+  return state.get(pin);
+}
+
+bool IonoLoRaRemoteSlave::write(uint8_t pin, float value) {
+  outbox.push_back(std::make_pair(pin, value));
+  return true;
+}
+
+word IonoLoRaRemoteSlave::diCount(uint8_t pin) {
+  return (pin >= DI1 && pin <= DI6) ? state.counts[pin - DI1] : 0;
+}
+
+word IonoLoRaRemoteSlave::stateAge() {
+  if (!hasState) {
+    return 0xFFFF;
+  }
+  return min((millis() - stateTs) / 1000, 0xFFFEul);
+}
+
+void IonoLoRaLocalMaster::setSlaves(LoRaRemoteSlave **slaves, int num) {
+  _slaves = slaves;
+  _num = num;
+  _max = num;
+  _discovery = false;
+}
+
+void IonoLoRaLocalMaster::enableDiscovery(LoRaRemoteSlave **slaves, int max) {
+  _slaves = slaves;
+  _num = 0;
+  _max = max;
+  _discovery = true;
+}
+
+/*
+  Receives one frame and sends one queued write per call
+*/
+void IonoLoRaLocalMaster::process() {
+  std::vector<uint8_t> frame;
+  int rssi;
+  float snr;
+  if (LoRa.radio.receive(frame, &rssi, &snr)) {
+    byte addr;
+    sim::UnitState state;
+    if (sim::decodeState(frame, &addr, &state)) {
+      IonoLoRaRemoteSlave *slave = NULL;
+      for (int i = 0; i < _num; i++) {
+        if (_slaves[i]->getAddr() == addr) {
+          slave = (IonoLoRaRemoteSlave *) _slaves[i];
+          break;
+        }
+      }
+      if (slave == NULL && _discovery && _num < _max) {
+        slave = (IonoLoRaRemoteSlave *) _slaves[_num++];
+        slave->setAddr(addr);
+      }
+      if (slave != NULL) {
+        slave->state = state;
+        slave->hasState = true;
+        slave->stateTs = millis();
+        slave->rssi = rssi;
+        slave->snr = snr;
+      }
+    }
+  }
+  for (int n = 0; n < _num; n++) {
+    if (_next >= _num) {
+      _next = 0;
+    }
+    IonoLoRaRemoteSlave *slave = (IonoLoRaRemoteSlave *) _slaves[_next++];
+    if (slave->outbox.empty()) {
+      continue;
+    }
+    std::pair<uint8_t, float> w = slave->outbox.front();
+    if (LoRaNet.transmit(sim::encodeCommand(slave->getAddr(), w.first, w.second))) {
+      slave->outbox.pop_front();
+    }
+    break;
+  }
+}
+
+byte IonoLoRaLocalSlave::_addr = 0;
+bool IonoLoRaLocalSlave::_dirty = false;
+bool IonoLoRaLocalSlave::_reported[IONO_PINS];
+float IonoLoRaLocalSlave::_values[IONO_PINS];
+unsigned long IonoLoRaLocalSlave::commands = 0;
+
+void IonoLoRaLocalSlave::setAddr(byte addr) {
+  _addr = addr;
+}
+
+/*
+  Applies the commands received and sends the state, with the last
+  reported values of the subscribed pins, if any was reported. Being
+  served wakes the radio up.
+*/
+void IonoLoRaLocalSlave::process() {
+  LoRa.receive();
+  std::vector<uint8_t> frame;
+  while (LoRa.radio.receive(frame)) {
+    byte addr;
+    uint8_t pin;
+    float value;
+    if (sim::decodeCommand(frame, &addr, &pin, &value) && addr == _addr) {
+      Iono.write(pin, value);
+      commands++;
+    }
+  }
+  Iono.process();
+  if (!_dirty) {
+    return;
+  }
+  sim::UnitState state;
+  for (int pin = 1; pin < IONO_PINS; pin++) {
+    state.set(pin, _reported[pin] ? _values[pin] : Iono.read(pin));
+  }
+  for (int i = 0; i < 6; i++) {
+    state.counts[i] = Iono.count(DI1 + i);
+  }
+  if (LoRaNet.transmit(sim::encodeState(_addr, state))) {
+    _dirty = false;
+  }
+}
+
+void IonoLoRaLocalSlave::subscribeCallback(uint8_t pin, float value) {
+  if (pin < IONO_PINS) {
+    _reported[pin] = true;
+    _values[pin] = value;
+  }
+  _dirty = true;
+}
@@ -0,0 +1,111 @@
+/*
+  IonoLoRaNet.h - host stub of the Iono MKR LoRaNet library for the
+  LoRaBus tests
+
+    Copyright (C) 2018-2022 Sfera Labs S.r.l. - All rights reserved.
+
+    For information, see:
+    http://www.sferalabs.cc/
+
+  This code is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+  See file LICENSE.txt for further informations on licensing terms.
+*/
+
+#ifndef IonoLoRaNet_h
+#define IonoLoRaNet_h
+
+#include "Arduino.h"
+#include "Iono.h"
+#include "LoRa.h"
+#include "Sim.h"
+
+#define __DEBUGprintln(x)
+
+/*
+  Frames are exchanged on the simulated channel through the sketch's
+  radio with the format of Sim.h, not the one of the real library: each
+  write is a command frame, each state update carries the whole state.
+  The duty cycle limiter holds frames exceeding the budget, as the
+  library does.
+*/
+class LoRaNetClass {
+  private:
+    unsigned long long _winUs = 0;
+    unsigned long long _budgetUs = 0;
+    unsigned long long _usedUs = 0;
+    unsigned long long _winStart = 0;
+
+  public:
+    unsigned long held = 0;
+    unsigned long sent = 0;
+
+    void init(byte *siteId, int siteIdLen, byte *pwd);
+    void setDutyCycle(uint16_t window, uint16_t dc);
+
+    // library internals
+    bool transmit(const std::vector<uint8_t> &frame);
+};
+
+extern LoRaNetClass LoRaNet;
+
+class LoRaRemoteSlave {
+  protected:
+    byte _addr = 0;
+
+  public:
+    virtual ~LoRaRemoteSlave() {}
+    virtual byte getAddr() { return _addr; }
+    virtual void setAddr(byte addr) { _addr = addr; }
+};
+
+class IonoLoRaRemoteSlave : public LoRaRemoteSlave {
+  public:
+    sim::UnitState state;
+    bool hasState = false;
+    unsigned long stateTs = 0;
+    int rssi = 0;
+    float snr = 0;
+    std::deque<std::pair<uint8_t, float> > outbox;
+
+    float read(uint8_t pin);
+    bool write(uint8_t pin, float value);
+    word diCount(uint8_t pin);
+    int loraRssi() { return rssi; }
+    float loraSnr() { return snr; }
+    word stateAge();
+};
+
+class IonoLoRaLocalMaster {
+  private:
+    LoRaRemoteSlave **_slaves = NULL;
+    int _num = 0;
+    int _max = 0;
+    bool _discovery = false;
+    int _next = 0;
+
+  public:
+    void setSlaves(LoRaRemoteSlave **slaves, int num);
+    void enableDiscovery(LoRaRemoteSlave **slaves, int max);
+    void process();
+};
+
+class IonoLoRaLocalSlave {
+  private:
+    static byte _addr;
+    static bool _dirty;
+    static bool _reported[IONO_PINS];
+    static float _values[IONO_PINS];
+
+  public:
+    static unsigned long commands;
+
+    void setAddr(byte addr);
+    void setUpdatesInterval(uint8_t pin, unsigned long interval) {}
+    void process();
+    static void subscribeCallback(uint8_t pin, float value);
+};
+
+#endif
@@ -0,0 +1,156 @@
+/*
+  IonoModbusRtuSlave.cpp - host stub of the Iono Modbus RTU slave
+  library for the LoRaBus tests
+
+    Copyright (C) 2018-2022 Sfera Labs S.r.l. - All rights reserved.
+
+    For information, see:
+    http://www.sferalabs.cc/
+
+  This code is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+  See file LICENSE.txt for further informations on licensing terms.
+*/
+
+#include "IonoModbusRtuSlave.h"
+
+ModbusRtuSlaveClass ModbusRtuSlave;
+IonoModbusRtuSlaveClass IonoModbusRtuSlave;
+
+std::vector<uint8_t> ModbusRtuSlaveClass::_response;
+int ModbusRtuSlaveClass::_bits = 0;
+size_t ModbusRtuSlaveClass::_lastAvail = 0;
+unsigned long long ModbusRtuSlaveClass::_lastTs = 0;
+ModbusCustomHandler ModbusRtuSlaveClass::handler = NULL;
+unsigned long ModbusRtuSlaveClass::frames = 0;
+unsigned long ModbusRtuSlaveClass::errors = 0;
+
+bool ModbusRtuSlaveClass::responseAddBit(bool on) {
+  if (_bits % 8 == 0) {
+    _response.push_back(0);
+  }
+  if (on) {
+    _response.back() |= 1 << (_bits % 8);
+  }
+  _bits++;
+  return true;
+}
+
+bool ModbusRtuSlaveClass::responseAddRegister(word value) {
+  _response.push_back(value >> 8);
+  _response.push_back(value & 0xFF);
+  return true;
+}
+
+bool ModbusRtuSlaveClass::getDataCoil(byte function, byte *data, int idx) {
+  if (function == MB_FC_WRITE_SINGLE_COIL) {
+    return data[0] == 0xFF;
+  }
+  return (data[1 + idx / 8] >> (idx % 8)) & 1;
+}
+
+word ModbusRtuSlaveClass::getDataRegister(byte function, byte *data, int idx) {
+  if (function == MB_FC_WRITE_SINGLE_REGISTER) {
+    return (data[0] << 8) | data[1];
+  }
+  return (data[1 + 2 * idx] << 8) | data[2 + 2 * idx];
+}
+
+/*
+  The response is written and flushed before returning, as the library
+  does
+*/
+void ModbusRtuSlaveClass::_respond(const std::vector<uint8_t> &pdu, byte unitAddr) {
+  std::vector<uint8_t> frame = sim::rtuFrame(pdu);
+  sim::advance(frame.size() * (unsigned long long) sim::bus.byteUs());
+  sim::bus.response = frame;
+  sim::bus.responseTs = sim::nowUs;
+  sim::bus.responses++;
+}
+
+void ModbusRtuSlaveClass::process() {
+  size_t avail = 0;
+  for (const std::pair<unsigned long long, uint8_t> &b : sim::bus.toSlave) {
+    if (b.first > sim::nowUs) {
+      break;
+    }
+    avail++;
+  }
+  if (avail == 0) {
+    return;
+  }
+  if (avail > _lastAvail + SIM_UART_RX_SIZE) {
+    // received while the sketch was blocked, past the RX buffer's room
+    size_t lost = avail - _lastAvail - SIM_UART_RX_SIZE;
+    sim::bus.toSlave.erase(sim::bus.toSlave.begin() + _lastAvail + SIM_UART_RX_SIZE,
+        sim::bus.toSlave.begin() + avail);
+    sim::bus.overruns += lost;
+    avail -= lost;
+  }
+  if (avail != _lastAvail) {
+    _lastAvail = avail;
+    _lastTs = sim::nowUs;
+    return;
+  }
+  unsigned long t35 = sim::bus.baud > 19200 ? 1750 : sim::bus.byteUs() * 7 / 2;
+  if (sim::nowUs - _lastTs < t35) {
+    return;
+  }
+  std::vector<uint8_t> req;
+  for (size_t i = 0; i < avail; i++) {
+    req.push_back(sim::bus.toSlave.front().second);
+    sim::bus.toSlave.pop_front();
+  }
+  _lastAvail = 0;
+  if (req.size() < 8 || sim::crc16(req.data(), req.size() - 2)
+      != (req[req.size() - 2] | (req[req.size() - 1] << 8))) {
+    errors++;
+    return;
+  }
+  frames++;
+  byte unitAddr = req[0];
+  byte function = req[1];
+  word regAddr = (req[2] << 8) | req[3];
+  word qty = (req[4] << 8) | req[5];
+  byte *data = &req[6];
+  if (function == MB_FC_WRITE_SINGLE_COIL || function == MB_FC_WRITE_SINGLE_REGISTER) {
+    qty = 1;
+    data = &req[4];
+  }
+  _response.clear();
+  _bits = 0;
+  byte res = handler != NULL ? handler(unitAddr, function, regAddr, qty, data) : MB_RESP_PASS;
+  if (res == MB_RESP_PASS) {
+    res = MB_EX_ILLEGAL_FUNCTION;
+  }
+  if (unitAddr == 0 || res == MB_RESP_IGNORE) {
+    return;
+  }
+  std::vector<uint8_t> pdu;
+  pdu.push_back(unitAddr);
+  if (res != MB_RESP_OK) {
+    pdu.push_back(function | 0x80);
+    pdu.push_back(res);
+  } else if (function <= MB_FC_READ_INPUT_REGISTER) {
+    pdu.push_back(function);
+    pdu.push_back(_response.size());
+    pdu.insert(pdu.end(), _response.begin(), _response.end());
+  } else {
+    pdu.insert(pdu.end(), req.begin() + 1, req.begin() + 6);
+  }
+  _respond(pdu, unitAddr);
+}
+
+void IonoModbusRtuSlaveClass::begin(byte unitAddr, unsigned long baud, unsigned long config, unsigned long diDebounceTime) {
+  sim::bus.baud = baud;
+}
+
+void IonoModbusRtuSlaveClass::setCustomHandler(ModbusCustomHandler handler) {
+  ModbusRtuSlaveClass::handler = handler;
+}
+
+void IonoModbusRtuSlaveClass::process() {
+  ModbusRtuSlave.process();
+}
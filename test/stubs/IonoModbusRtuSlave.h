@@ -0,0 +1,83 @@
+/*
+  IonoModbusRtuSlave.h - host stub of the Iono Modbus RTU slave library
+  for the LoRaBus tests
+
+    Copyright (C) 2018-2022 Sfera Labs S.r.l. - All rights reserved.
+
+    For information, see:
+    http://www.sferalabs.cc/
+
+  This code is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+  See file LICENSE.txt for further informations on licensing terms.
+*/
+
+#ifndef IonoModbusRtuSlave_h
+#define IonoModbusRtuSlave_h
+
+#include "Arduino.h"
+#include "Sim.h"
+
+#define MB_FC_READ_COILS                0x01
+#define MB_FC_READ_DISCRETE_INPUTS      0x02
+#define MB_FC_READ_HOLDING_REGISTERS    0x03
+#define MB_FC_READ_INPUT_REGISTER       0x04
+#define MB_FC_WRITE_SINGLE_COIL         0x05
+#define MB_FC_WRITE_SINGLE_REGISTER     0x06
+#define MB_FC_WRITE_MULTIPLE_COILS      0x0F
+#define MB_FC_WRITE_MULTIPLE_REGISTERS  0x10
+
+#define MB_RESP_OK      0x00
+#define MB_RESP_PASS    0xFE
+#define MB_RESP_IGNORE  0xFF
+
+#define MB_EX_ILLEGAL_FUNCTION      0x01
+#define MB_EX_ILLEGAL_DATA_ADDRESS  0x02
+#define MB_EX_ILLEGAL_DATA_VALUE    0x03
+
+typedef byte (*ModbusCustomHandler)(byte unitAddr, byte function, word regAddr, word qty, byte *data);
+
+/*
+  Reads requests from the simulated bus: a frame is taken once no new
+  byte has been received for 3.5 characters since the last poll that
+  saw one, as a polled receiver does. Each poll empties the serial port's
+  RX buffer: bytes received since the previous poll beyond its
+  SIM_UART_RX_SIZE are lost. Requests the handler passes are answered
+  with an illegal function exception.
+*/
+class ModbusRtuSlaveClass {
+  private:
+    static std::vector<uint8_t> _response;
+    static int _bits;
+    static size_t _lastAvail;
+    static unsigned long long _lastTs;
+
+    static void _respond(const std::vector<uint8_t> &pdu, byte unitAddr);
+
+  public:
+    static ModbusCustomHandler handler;
+    static unsigned long frames;
+    static unsigned long errors;
+
+    static bool responseAddBit(bool on);
+    static bool responseAddRegister(word value);
+    static bool getDataCoil(byte function, byte *data, int idx);
+    static word getDataRegister(byte function, byte *data, int idx);
+    static void process();
+};
+
+extern ModbusRtuSlaveClass ModbusRtuSlave;
+
+class IonoModbusRtuSlaveClass {
+  public:
+    static void setInputMode(int idx, char mode) {}
+    static void begin(byte unitAddr, unsigned long baud, unsigned long config, unsigned long diDebounceTime);
+    static void setCustomHandler(ModbusCustomHandler handler);
+    static void process();
+};
+
+extern IonoModbusRtuSlaveClass IonoModbusRtuSlave;
+
+#endif
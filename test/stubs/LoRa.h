@@ -0,0 +1,68 @@
+/*
+  LoRa.h - host stub of the arduino-LoRa library for the LoRaBus tests
+
+    Copyright (C) 2018-2022 Sfera Labs S.r.l. - All rights reserved.
+
+    For information, see:
+    http://www.sferalabs.cc/
+
+  This code is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+  See file LICENSE.txt for further informations on licensing terms.
+*/
+
+#ifndef LoRa_h
+#define LoRa_h
+
+#include "Arduino.h"
+#include "Sim.h"
+
+/*
+  The sketch's radio on the simulated channel: transmissions block for
+  their time-on-air, as endPacket() does
+*/
+class LoRaClass {
+  public:
+    sim::Radio radio;
+    bool begun = false;
+
+    LoRaClass() {
+      radio.blocking = true;
+    }
+
+    int begin(long frequency) {
+      radio.freq = frequency / 1000;
+      begun = true;
+      return 1;
+    }
+
+    void enableCrc() {}
+    void setSyncWord(int sw) {}
+    void setTxPower(int level) {}
+
+    void setSpreadingFactor(int sf) {
+      radio.sf = sf;
+    }
+
+    int rssi() {
+      return radio.busy() ? sim::channel.rssi : SIM_NOISE_RSSI;
+    }
+
+    void sleep() {
+      radio.sleep();
+    }
+
+    void idle() {
+      radio.wake();
+    }
+
+    void receive() {
+      radio.wake();
+    }
+};
+
+extern LoRaClass LoRa;
+
+#endif
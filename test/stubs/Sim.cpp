@@ -0,0 +1,636 @@
+/*
+  Sim.cpp - simulated time, flash, radio channel, RS-485 bus and peer
+  devices for the LoRaBus host tests
+
+    Copyright (C) 2018-2022 Sfera Labs S.r.l. - All rights reserved.
+
+    For information, see:
+    http://www.sferalabs.cc/
+
+  This code is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+  See file LICENSE.txt for further informations on licensing terms.
+*/
+
+#include "Sim.h"
+
+#define SIM_SPINS_ADVANCE  1000     // input polls at the same time before jumping to the next input
+#define SIM_SPINS_MAX      100000   // input polls at the same time with no input left
+#define SIM_AIR_KEEP_US    60000000ull
+
+namespace sim {
+
+unsigned long long nowUs = 0;
+unsigned long loopUs = 100;
+unsigned long flashRowUs = 8000;
+long powerCut = -1;
+bool flashWorn = false;
+Channel channel;
+Bus bus;
+byte siteId[3] = {'A', 'B', 'C'};
+
+static std::mt19937 _rng(1);
+
+void advance(unsigned long long us) {
+  nowUs += us;
+}
+
+void seed(unsigned long s) {
+  _rng.seed(s);
+}
+
+unsigned long rand32() {
+  return _rng();
+}
+
+void flashWrite(uint8_t *dst, const void *src, size_t len) {
+  advance(((len + 255) / 256) * flashRowUs);
+  memset(dst, 0xFF, len);
+  if (flashWorn) {
+    return;
+  }
+  if (powerCut >= 0 && (size_t) powerCut < len) {
+    memcpy(dst, src, powerCut);
+    powerCut = -1;
+    throw PowerLoss();
+  }
+  if (powerCut >= 0) {
+    powerCut -= len;
+  }
+  memcpy(dst, src, len);
+}
+
+/*
+  Time-on-air of a frame: 125 kHz bandwidth, coding rate 4/5, 8 symbols
+  preamble, explicit header and CRC (Semtech AN1200.13)
+*/
+unsigned long timeOnAirUs(byte sf, int len) {
+  double tSym = (double) (1 << sf) / 125000.0;
+  int de = sf >= 11 ? 1 : 0;
+  double n = ceil((8.0 * len - 4 * sf + 28 + 16) / (4.0 * (sf - 2 * de)));
+  double nPayload = 8 + (n > 0 ? n * 5 : 0);
+  return (unsigned long) ((8 + 4.25 + nPayload) * tSym * 1000000.0);
+}
+
+struct Transmission {
+  Radio *src;
+  long freq;
+  unsigned long long start;
+  unsigned long long end;
+  std::vector<uint8_t> bytes;
+  std::vector<Radio *> done;
+};
+
+static std::deque<Transmission> _air;
+
+static std::vector<Radio *> &_radios() {
+  static std::vector<Radio *> radios;
+  return radios;
+}
+
+static bool _overlap(const Transmission &a, const Transmission &b) {
+  return a.start < b.end && b.start < a.end;
+}
+
+Radio::Radio() {
+  _createdTs = nowUs;
+  awakeSince = nowUs;
+  _radios().push_back(this);
+}
+
+Radio::~Radio() {
+  std::vector<Radio *> &radios = _radios();
+  radios.erase(std::remove(radios.begin(), radios.end(), this), radios.end());
+  for (Transmission &t : _air) {
+    if (t.src == this) {
+      t.src = NULL;
+    }
+  }
+}
+
+void Radio::transmit(const std::vector<uint8_t> &frame) {
+  while (!_air.empty() && _air.front().end + SIM_AIR_KEEP_US < nowUs) {
+    _air.pop_front();
+  }
+  wake();
+  Transmission t;
+  t.src = this;
+  t.freq = freq;
+  t.start = nowUs;
+  t.end = nowUs + timeOnAirUs(sf, frame.size());
+  t.bytes = frame;
+  _air.push_back(t);
+  channel.frames++;
+  txFrames++;
+  txUs += t.end - t.start;
+  if (blocking) {
+    advance(t.end - t.start);
+  }
+}
+
+bool Radio::receive(std::vector<uint8_t> &frame, int *rssi, float *snr) {
+  if (!awake) {
+    return false;
+  }
+  for (Transmission &t : _air) {
+    if (t.src == this || t.freq != freq || t.start < _createdTs
+        || t.end + channel.latencyMs * 1000ull > nowUs
+        || std::find(t.done.begin(), t.done.end(), this) != t.done.end()) {
+      continue;
+    }
+    t.done.push_back(this);
+    if (awakeSince > t.start) {
+      continue;
+    }
+    bool lost = false;
+    for (const Transmission &u : _air) {
+      if (&u == &t || u.freq != freq || !_overlap(t, u)) {
+        continue;
+      }
+      if (u.src == this) {
+        // half duplex
+        lost = true;
+      } else if (channel.collisions) {
+        channel.collided++;
+        lost = true;
+      }
+      break;
+    }
+    if (lost) {
+      continue;
+    }
+    if (channel.loss > 0 && (rand32() % 1000000) < channel.loss * 1000000) {
+      channel.lost++;
+      continue;
+    }
+    frame = t.bytes;
+    if (rssi != NULL) {
+      *rssi = channel.rssi;
+    }
+    if (snr != NULL) {
+      *snr = channel.snr;
+    }
+    rxFrames++;
+    return true;
+  }
+  return false;
+}
+
+bool Radio::busy() {
+  for (const Transmission &t : _air) {
+    if (t.src != this && t.freq == freq && t.start <= nowUs && nowUs < t.end) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void Radio::sleep() {
+  if (!awake) {
+    return;
+  }
+  // the FIFO is lost in sleep mode
+  for (Transmission &t : _air) {
+    if (t.end <= nowUs && std::find(t.done.begin(), t.done.end(), this) == t.done.end()) {
+      t.done.push_back(this);
+    }
+  }
+  rxUs += nowUs - awakeSince;
+  awake = false;
+}
+
+void Radio::wake() {
+  if (awake) {
+    return;
+  }
+  awake = true;
+  awakeSince = nowUs;
+}
+
+UnitState::UnitState() {
+  for (int i = 0; i < 22; i++) {
+    pins[i] = 0;
+  }
+  for (int i = 0; i < 6; i++) {
+    counts[i] = 0;
+  }
+}
+
+float UnitState::get(uint8_t pin) const {
+  return pin < 22 ? pins[pin] : -1;
+}
+
+void UnitState::set(uint8_t pin, float value) {
+  if (pin < 22) {
+    pins[pin] = value;
+  }
+}
+
+static void _putHeader(std::vector<uint8_t> &f, char type, byte addr) {
+  f.push_back(type);
+  f.insert(f.end(), siteId, siteId + 3);
+  f.push_back(addr);
+}
+
+static bool _checkHeader(const std::vector<uint8_t> &f, char type, size_t len, byte *addr) {
+  if (f.size() != len || f[0] != type || memcmp(&f[1], siteId, 3) != 0) {
+    return false;
+  }
+  *addr = f[4];
+  return true;
+}
+
+std::vector<uint8_t> encodeState(byte addr, const UnitState &state) {
+  std::vector<uint8_t> f;
+  _putHeader(f, SIM_FRAME_STATE, addr);
+  const uint8_t *p = (const uint8_t *) &state;
+  f.insert(f.end(), p, p + sizeof(UnitState));
+  return f;
+}
+
+bool decodeState(const std::vector<uint8_t> &frame, byte *addr, UnitState *state) {
+  if (!_checkHeader(frame, SIM_FRAME_STATE, 5 + sizeof(UnitState), addr)) {
+    return false;
+  }
+  memcpy(state, &frame[5], sizeof(UnitState));
+  return true;
+}
+
+std::vector<uint8_t> encodeCommand(byte addr, uint8_t pin, float value) {
+  std::vector<uint8_t> f;
+  _putHeader(f, SIM_FRAME_COMMAND, addr);
+  f.push_back(pin);
+  const uint8_t *p = (const uint8_t *) &value;
+  f.insert(f.end(), p, p + sizeof(float));
+  return f;
+}
+
+bool decodeCommand(const std::vector<uint8_t> &frame, byte *addr, uint8_t *pin, float *value) {
+  if (!_checkHeader(frame, SIM_FRAME_COMMAND, 10, addr)) {
+    return false;
+  }
+  *pin = frame[5];
+  memcpy(value, &frame[6], sizeof(float));
+  return true;
+}
+
+static std::vector<Node *> &_nodes() {
+  static std::vector<Node *> nodes;
+  return nodes;
+}
+
+Node::Node() {
+  _nodes().push_back(this);
+}
+
+Node::~Node() {
+  std::vector<Node *> &nodes = _nodes();
+  nodes.erase(std::remove(nodes.begin(), nodes.end(), this), nodes.end());
+}
+
+void processNodes() {
+  std::vector<Node *> nodes = _nodes();
+  for (Node *n : nodes) {
+    n->process();
+  }
+}
+
+Unit::Unit(byte addr, long freq, byte sf) : addr(addr) {
+  radio.freq = freq;
+  radio.sf = sf;
+}
+
+void Unit::set(uint8_t pin, float value) {
+  if (pin >= 7 && pin <= 12 && value != 0 && state.get(pin) == 0) {
+    state.counts[pin - 7]++;
+  }
+  state.set(pin, value);
+  _dirty = true;
+  _reportTs = nowUs;
+}
+
+void Unit::report() {
+  radio.transmit(encodeState(addr, state));
+  updates++;
+  _lastTs = nowUs;
+  _dirty = false;
+}
+
+void Unit::process() {
+  std::vector<uint8_t> frame;
+  while (radio.receive(frame)) {
+    byte a;
+    uint8_t pin;
+    float value;
+    if (decodeCommand(frame, &a, &pin, &value) && a == addr) {
+      state.set(pin, value);
+      commands++;
+      if (!_dirty) {
+        _dirty = true;
+        _reportTs = nowUs + processMs * 1000ull;
+      }
+    }
+  }
+  if (_dirty && nowUs >= _reportTs) {
+    report();
+  } else if (heartbeatMs > 0 && nowUs - _lastTs >= heartbeatMs * 1000ull) {
+    report();
+  }
+}
+
+Gateway::Gateway(long freq, byte sf) {
+  radio.freq = freq;
+  radio.sf = sf;
+}
+
+void Gateway::command(byte addr, uint8_t pin, float value) {
+  radio.transmit(encodeCommand(addr, pin, value));
+}
+
+void Gateway::process() {
+  std::vector<uint8_t> frame;
+  while (radio.receive(frame)) {
+    byte addr;
+    UnitState state;
+    if (decodeState(frame, &addr, &state)) {
+      states[addr] = state;
+      updates[addr]++;
+      updateTs.push_back(nowUs);
+    }
+  }
+}
+
+void Bus::send(const std::vector<uint8_t> &frame) {
+  unsigned long long ts = nowUs;
+  if (!toSlave.empty() && toSlave.back().first > ts) {
+    ts = toSlave.back().first;
+  }
+  for (uint8_t b : frame) {
+    ts += byteUs();
+    toSlave.push_back(std::make_pair(ts, b));
+  }
+}
+
+void Bus::clear() {
+  toSlave.clear();
+  response.clear();
+  responseTs = 0;
+}
+
+uint16_t crc16(const uint8_t *data, size_t len) {
+  uint16_t crc = 0xFFFF;
+  for (size_t i = 0; i < len; i++) {
+    crc ^= data[i];
+    for (int b = 0; b < 8; b++) {
+      crc = (crc & 1) ? (crc >> 1) ^ 0xA001 : crc >> 1;
+    }
+  }
+  return crc;
+}
+
+std::vector<uint8_t> rtuFrame(std::vector<uint8_t> pdu) {
+  uint16_t crc = crc16(pdu.data(), pdu.size());
+  pdu.push_back(crc & 0xFF);
+  pdu.push_back(crc >> 8);
+  return pdu;
+}
+
+}
+
+// Arduino core
+
+Uart Serial;
+Uart Serial1;
+
+unsigned long millis() {
+  return (unsigned long) (sim::nowUs / 1000);
+}
+
+unsigned long micros() {
+  return (unsigned long) sim::nowUs;
+}
+
+void delay(unsigned long ms) {
+  sim::advance(ms * 1000ull);
+}
+
+void delayMicroseconds(unsigned int us) {
+  sim::advance(us);
+}
+
+long random(long max) {
+  return max <= 0 ? 0 : (long) (sim::rand32() % (unsigned long) max);
+}
+
+long random(long min, long max) {
+  return min >= max ? min : min + random(max - min);
+}
+
+void randomSeed(unsigned long seed) {
+  sim::seed(seed);
+}
+
+void pinMode(int pin, int mode) {
+}
+
+void digitalWrite(int pin, int value) {
+}
+
+void NVIC_SystemReset() {
+  throw sim::Reset();
+}
+
+size_t Print::write(const char *str) {
+  size_t n = 0;
+  while (*str) {
+    n += write((uint8_t) *str++);
+  }
+  return n;
+}
+
+size_t Print::print(const char *str) {
+  return write(str);
+}
+
+size_t Print::print(char c) {
+  return write((uint8_t) c);
+}
+
+size_t Print::print(unsigned char n, int base) {
+  return print((unsigned long) n, base);
+}
+
+size_t Print::print(int n, int base) {
+  return print((long) n, base);
+}
+
+size_t Print::print(unsigned int n, int base) {
+  return print((unsigned long) n, base);
+}
+
+size_t Print::print(long n, int base) {
+  if (base == DEC && n < 0) {
+    return print('-') + print((unsigned long) -n, base);
+  }
+  return print((unsigned long) n, base);
+}
+
+size_t Print::print(unsigned long n, int base) {
+  char buf[24];
+  snprintf(buf, sizeof(buf), base == HEX ? "%lX" : "%lu", n);
+  return write(buf);
+}
+
+size_t Print::print(double n, int digits) {
+  char buf[48];
+  snprintf(buf, sizeof(buf), "%.*f", digits, n);
+  return write(buf);
+}
+
+size_t Print::println(const char *str) {
+  return print(str) + print("\r\n");
+}
+
+void Stream::setTimeout(unsigned long timeout) {
+  _timeout = timeout;
+}
+
+size_t Stream::readBytes(char *buffer, size_t length) {
+  return readBytes((uint8_t *) buffer, length);
+}
+
+size_t Stream::readBytes(uint8_t *buffer, size_t length) {
+  size_t n = 0;
+  while (n < length) {
+    int c = timedRead();
+    if (c < 0) {
+      break;
+    }
+    buffer[n++] = c;
+  }
+  return n;
+}
+
+int Stream::timedRead() {
+  unsigned long start = millis();
+  do {
+    int c = read();
+    if (c >= 0) {
+      return c;
+    }
+    delay(1);
+  } while (millis() - start < _timeout);
+  return -1;
+}
+
+void Uart::begin(unsigned long baud, uint16_t config) {
+  open = true;
+}
+
+void Uart::end() {
+  open = false;
+}
+
+/*
+  Returns true if input is available now. Polling again and again at the
+  same time means the sketch is busy-waiting for input: the clock jumps
+  to the next input, if any.
+*/
+bool Uart::_ready() {
+  while (!_input.empty() && _input.front().data.empty()) {
+    _input.pop_front();
+  }
+  if (!_input.empty() && _input.front().ts <= sim::nowUs) {
+    return true;
+  }
+  if (_spinTs != sim::nowUs) {
+    _spinTs = sim::nowUs;
+    _spins = 0;
+  }
+  _spins++;
+  if (!_input.empty() && _spins > SIM_SPINS_ADVANCE) {
+    sim::nowUs = _input.front().ts;
+    return true;
+  }
+  if (_input.empty() && _spins > SIM_SPINS_MAX) {
+    throw sim::InputExhausted();
+  }
+  return false;
+}
+
+int Uart::available() {
+  if (!_ready()) {
+    return 0;
+  }
+  int n = 0;
+  for (const Chunk &c : _input) {
+    if (c.ts > sim::nowUs) {
+      break;
+    }
+    n += c.data.size();
+  }
+  return n;
+}
+
+int Uart::read() {
+  if (!_ready()) {
+    return -1;
+  }
+  uint8_t c = _input.front().data[0];
+  _input.front().data.erase(0, 1);
+  return c;
+}
+
+int Uart::peek() {
+  if (!_ready()) {
+    return -1;
+  }
+  return (uint8_t) _input.front().data[0];
+}
+
+int Uart::timedRead() {
+  unsigned long long deadline = sim::nowUs + _timeout * 1000ull;
+  while (!_input.empty() && _input.front().data.empty()) {
+    _input.pop_front();
+  }
+  if (_input.empty() || _input.front().ts > deadline) {
+    sim::nowUs = deadline;
+    return -1;
+  }
+  if (_input.front().ts > sim::nowUs) {
+    sim::nowUs = _input.front().ts;
+  }
+  return read();
+}
+
+size_t Uart::write(uint8_t c) {
+  output += (char) c;
+  return 1;
+}
+
+void Uart::input(const char *data, unsigned long delayMs) {
+  unsigned long long ts = sim::nowUs + delayMs * 1000ull;
+  if (!_input.empty() && _input.back().ts > ts) {
+    ts = _input.back().ts;
+  }
+  Chunk c;
+  c.ts = ts;
+  c.data = data;
+  _input.push_back(c);
+}
+
+bool Uart::pending() {
+  for (const Chunk &c : _input) {
+    if (!c.data.empty()) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void Uart::clear() {
+  _input.clear();
+  output.clear();
+}
@@ -0,0 +1,201 @@
+/*
+  Sim.h - simulated time, flash, radio channel, RS-485 bus and peer
+  devices for the LoRaBus host tests
+
+    Copyright (C) 2018-2022 Sfera Labs S.r.l. - All rights reserved.
+
+    For information, see:
+    http://www.sferalabs.cc/
+
+  This code is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+  See file LICENSE.txt for further informations on licensing terms.
+*/
+
+#ifndef Sim_h
+#define Sim_h
+
+#include "Arduino.h"
+
+#define SIM_FRAME_STATE   'S'
+#define SIM_FRAME_COMMAND 'C'
+#define SIM_NOISE_RSSI    -120
+
+/*
+  The sketch runs in the test process on a simulated clock: the clock
+  only advances when the test steps the loop, when the sketch waits
+  (delay(), serial timeouts) or blocks on the hardware (radio
+  transmissions, flash writes).
+*/
+namespace sim {
+
+struct Reset {};           // NVIC_SystemReset() called
+struct PowerLoss {};       // power cut during a flash write
+struct InputExhausted {};  // console waiting for input the test will never send
+
+extern unsigned long long nowUs;
+extern unsigned long loopUs;       // duration of one loop() iteration
+extern unsigned long flashRowUs;   // time to erase and write a 256 byte flash row
+extern long powerCut;              // bytes written to flash before a power cut, -1 for none
+extern bool flashWorn;             // flash writes leave the area erased
+
+void advance(unsigned long long us);
+void seed(unsigned long s);
+unsigned long rand32();
+
+/*
+  Writes len bytes to a flash area: the area is erased and written byte
+  by byte, throwing PowerLoss when the powerCut budget runs out. A worn
+  flash is left erased.
+*/
+void flashWrite(uint8_t *dst, const void *src, size_t len);
+
+/*
+  Radio channel shared by all the radios of the test: a frame reaches the
+  radios tuned on the same frequency that are awake for its whole
+  time-on-air and not transmitting, after the latency, unless lost at
+  random or colliding with another frame on the air at the same time.
+*/
+struct Channel {
+  unsigned long latencyMs = 0;
+  float loss = 0;
+  bool collisions = true;
+  int rssi = -70;
+  float snr = 8.5;
+  unsigned long frames = 0;
+  unsigned long collided = 0;
+  unsigned long lost = 0;
+};
+
+extern Channel channel;
+
+unsigned long timeOnAirUs(byte sf, int len);
+
+class Radio {
+  private:
+    unsigned long long _createdTs;
+
+  public:
+    long freq = 0;               // [kHz]
+    byte sf = 7;
+    bool awake = true;
+    bool blocking = false;       // transmissions block the caller, as on the sketch's radio
+    unsigned long long awakeSince = 0;
+    unsigned long txFrames = 0;
+    unsigned long rxFrames = 0;
+    unsigned long long txUs = 0;
+    unsigned long long rxUs = 0;   // time spent awake
+
+    Radio();
+    ~Radio();
+    void transmit(const std::vector<uint8_t> &frame);
+    bool receive(std::vector<uint8_t> &frame, int *rssi = NULL, float *snr = NULL);
+    bool busy();
+    void sleep();
+    void wake();
+    unsigned long long createdTs() { return _createdTs; }
+};
+
+/*
+  I/O state carried by the state updates of the simulated LoRaNet, with
+  the pins numbered as in Iono.h
+*/
+struct UnitState {
+  float pins[22];
+  word counts[6];
+
+  UnitState();
+  float get(uint8_t pin) const;
+  void set(uint8_t pin, float value);
+};
+
+extern byte siteId[3];
+
+std::vector<uint8_t> encodeState(byte addr, const UnitState &state);
+bool decodeState(const std::vector<uint8_t> &frame, byte *addr, UnitState *state);
+std::vector<uint8_t> encodeCommand(byte addr, uint8_t pin, float value);
+bool decodeCommand(const std::vector<uint8_t> &frame, byte *addr, uint8_t *pin, float *value);
+
+/*
+  Devices simulated next to the sketch, processed at every step
+*/
+class Node {
+  public:
+    Node();
+    virtual ~Node();
+    virtual void process() = 0;
+};
+
+void processNodes();
+
+/*
+  Remote unit simulated at the LoRaNet level: applies the commands it
+  receives and reports its state after the processing delay, on input
+  changes and every heartbeat period
+*/
+class Unit : public Node {
+  private:
+    bool _dirty = false;
+    unsigned long long _reportTs = 0;
+    unsigned long long _lastTs = 0;
+
+  public:
+    byte addr;
+    Radio radio;
+    UnitState state;
+    unsigned long processMs = 20;
+    unsigned long heartbeatMs = 0;
+    unsigned long commands = 0;
+    unsigned long updates = 0;
+
+    Unit(byte addr, long freq, byte sf = 7);
+    void set(uint8_t pin, float value);
+    void report();
+    void process() override;
+};
+
+/*
+  Gateway simulated at the LoRaNet level, for the remote unit tests
+*/
+class Gateway : public Node {
+  public:
+    Radio radio;
+    std::map<byte, UnitState> states;
+    std::map<byte, unsigned long> updates;
+    std::vector<unsigned long long> updateTs;
+
+    Gateway(long freq, byte sf = 7);
+    void command(byte addr, uint8_t pin, float value);
+    void process() override;
+};
+
+/*
+  RS-485 line between a Modbus RTU master and the sketch: request bytes
+  reach the sketch's UART at the bus speed, the response is collected
+  with the time its transmission ended
+*/
+#define SIM_UART_RX_SIZE 256  // RX ring buffer of the SAMD21 serial port
+
+struct Bus {
+  unsigned long baud = 19200;
+  std::deque<std::pair<unsigned long long, uint8_t> > toSlave;
+  std::vector<uint8_t> response;
+  unsigned long long responseTs = 0;
+  unsigned long responses = 0;
+  unsigned long overruns = 0;  // bytes lost for the RX buffer being full
+
+  unsigned long byteUs() const { return 11000000ul / baud; }
+  void send(const std::vector<uint8_t> &frame);
+  void clear();
+};
+
+extern Bus bus;
+
+uint16_t crc16(const uint8_t *data, size_t len);
+std::vector<uint8_t> rtuFrame(std::vector<uint8_t> pdu);
+
+}
+
+#endif
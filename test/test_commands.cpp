@@ -0,0 +1,65 @@
+/*
+  Delivery of the output writes to the remote units: commands are only
+  confirmed by a state update received after they were sent
+*/
+
+#include "LoRaBus.cpp"
+#include "Harness.h"
+
+using namespace harness;
+
+const char *CONFIG =
+  "[GATEWAY]\r\n"
+  "Unit address: 1\r\n"
+  "LoRa frequency: 869500\r\n"
+  "LoRa TX power: 14\r\n"
+  "LoRa spreading factor: 7\r\n"
+  "LoRa duty cycle: 10.00\r\n"
+  "LoRa duty cycle window: 600\r\n"
+  "Site ID: abc\r\n"
+  "Password: 16AsciiCharsPwrd\r\n"
+  "Input modes: DDVI-D\r\n"
+  "I/O rules: ----\r\n"
+  "Serial speed: 19200\r\n"
+  "Serial parity: Even\r\n"
+  "Remote units: 2\r\n";
+
+int main() {
+  boot(CONFIG);
+  sim::Unit unit(2, 869500);
+
+  CHECK_EQ(write(2, MB_FC_WRITE_SINGLE_COIL, 1, 1), 0);
+  CHECK(runUntil([&]() { return read(2, MB_FC_READ_INPUT_REGISTER, 5401) == CMD_IDLE; }, 5000));
+  CHECK_EQ(read(2, MB_FC_READ_COILS, 1), 1);
+  run(5000);
+
+  // DO1 switched off on the unit, its update lost: the image still
+  // shows DO1 on when it is commanded on again
+  unit.state.set(DO1, 0);
+  sim::channel.loss = 1;
+  CHECK_EQ(write(2, MB_FC_WRITE_SINGLE_COIL, 1, 0), 0);
+  run(100);
+  CHECK_EQ(write(2, MB_FC_WRITE_SINGLE_COIL, 1, 1), 0);
+  run(CMD_RETRY_TIME + 500);
+  CHECK_EQ(read(2, MB_FC_READ_INPUT_REGISTER, 5401), CMD_PENDING);
+  sim::channel.loss = 0;
+  CHECK(runUntil([&]() { return unit.state.get(DO1) == 1; }, 60000));
+  CHECK(runUntil([&]() { return read(2, MB_FC_READ_INPUT_REGISTER, 5401) == CMD_IDLE; }, 5000));
+  run(5000);
+
+  // same, with an update received less than 1 second before the send
+  unit.report();
+  run(400);
+  unit.state.set(DO1, 0);
+  sim::channel.loss = 1;
+  CHECK_EQ(write(2, MB_FC_WRITE_SINGLE_COIL, 1, 0), 0);
+  run(100);
+  CHECK_EQ(write(2, MB_FC_WRITE_SINGLE_COIL, 1, 1), 0);
+  run(500);
+  CHECK_EQ(read(2, MB_FC_READ_INPUT_REGISTER, 5401), CMD_PENDING);
+  sim::channel.loss = 0;
+  CHECK(runUntil([&]() { return unit.state.get(DO1) == 1; }, 60000));
+  CHECK(runUntil([&]() { return read(2, MB_FC_READ_INPUT_REGISTER, 5401) == CMD_IDLE; }, 5000));
+
+  return TEST_RESULT();
+}
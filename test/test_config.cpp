@@ -0,0 +1,66 @@
+/*
+  Configuration limits enforced by the console import
+*/
+
+#include "LoRaBus.cpp"
+#include "Harness.h"
+
+using namespace harness;
+
+std::string gatewayConfig(const std::string &extra) {
+  return std::string(
+    "[GATEWAY]\r\n"
+    "Unit address: 1\r\n"
+    "LoRa frequency: 869500\r\n"
+    "LoRa TX power: 14\r\n"
+    "LoRa spreading factor: 7\r\n"
+    "LoRa duty cycle: 10.00\r\n"
+    "LoRa duty cycle window: 600\r\n"
+    "Site ID: abc\r\n"
+    "Password: 16AsciiCharsPwrd\r\n"
+    "Input modes: DDVI-D\r\n"
+    "I/O rules: ----\r\n"
+    "Serial speed: 19200\r\n"
+    "Serial parity: Even\r\n") + extra;
+}
+
+std::string unitsList(int first, int last) {
+  std::string list;
+  for (int a = first; a <= last; a++) {
+    list += (a > first ? ", " : "") + std::to_string(a);
+  }
+  return list;
+}
+
+int main() {
+  // more remote units than the gateway is sized for
+  CHECK(!boot(gatewayConfig("Remote units: " + unitsList(2, MAX_SLAVES + 2) + "\r\n").c_str()));
+  CHECK(!SerialConfig.isConfigured);
+
+  // group addresses overlapping the gateway, a unit or another group
+  CHECK(!boot(gatewayConfig("Remote units: 2, 3\r\nGroup 1 address: 1\r\n").c_str()));
+  CHECK(!boot(gatewayConfig("Remote units: 2, 3\r\nGroup 1 address: 3\r\n").c_str()));
+  CHECK(!boot(gatewayConfig("Remote units: 2, 3\r\n"
+      "Group 1 address: 100\r\nGroup 2 address: 100\r\n").c_str()));
+  CHECK(!boot(gatewayConfig("Remote units: 2, 3\r\nGroup 1 address: 300\r\n").c_str()));
+  CHECK(!SerialConfig.isConfigured);
+
+  // other gateways frequencies out of range, repeated or equal to this one
+  CHECK(!boot(gatewayConfig("Remote units: 2, 3\r\nOther gateways frequencies: 8681\r\n").c_str()));
+  CHECK(!boot(gatewayConfig("Remote units: 2, 3\r\nOther gateways frequencies: 868100, 868100\r\n").c_str()));
+  CHECK(!boot(gatewayConfig("Remote units: 2, 3\r\nOther gateways frequencies: 869500\r\n").c_str()));
+  CHECK(!boot(gatewayConfig("Remote units: 2, 3\r\n"
+      "Other gateways frequencies: 868100, 868300, 868500, 868700, 868900\r\n").c_str()));
+  CHECK(!SerialConfig.isConfigured);
+
+  CHECK(boot(gatewayConfig("Remote units: " + unitsList(2, MAX_SLAVES + 1) + "\r\n"
+      "Group 1 address: 100\r\nGroup 2 address: 101\r\n"
+      "Other gateways frequencies: 868100, 869900\r\n").c_str()));
+  CHECK_EQ(SerialConfig.slavesNum, MAX_SLAVES);
+  CHECK_EQ(SerialConfig.groupsAddr[1], 101);
+  CHECK_EQ(SerialConfig.peersNum, 2);
+  CHECK_EQ(read(MAX_SLAVES + 1, MB_FC_READ_INPUT_REGISTER, 5101), 0xFFFF);
+  CHECK_EQ(read(MAX_SLAVES + 2, MB_FC_READ_INPUT_REGISTER, 5101), NO_RESPONSE);
+
+  return TEST_RESULT();
+}
@@ -0,0 +1,142 @@
+/*
+  Configuration saves cut by power losses at random points of the flash
+  write, each followed by a restart: the restart always finds either the
+  new or the previous configuration, the saves are spread evenly over
+  the slots and records with a bad CRC are skipped
+*/
+
+#include "LoRaBus.cpp"
+#include "Harness.h"
+
+using namespace harness;
+
+const int CYCLES = 5000;
+
+FlashStorageClass<ConfigRecord> *const slots[CONFIG_SLOTS] =
+    {&configSlot0, &configSlot1, &configSlot2, &configSlot3};
+
+void fill(ConfigData *d, int i) {
+  memset(d, 0, sizeof(ConfigData));
+  d->address = 1;
+  d->speed = 5;
+  d->parity = 1;
+  d->txPower = 14;
+  d->sf = 7;
+  d->frequency = 869500;
+  d->dc = 100;
+  d->dcWin = 600;
+  memcpy(d->siteId, "abc", 3);
+  memcpy(d->pwd, "16AsciiCharsPwrd", 16);
+  memcpy(d->modes, "DDVI-D", 6);
+  memcpy(d->rules, "----", 4);
+  d->slavesNum = 1 + i % CONFIG_SLAVES;
+  for (int s = 0; s < d->slavesNum; s++) {
+    d->slavesAddr[s] = 2 + s;
+  }
+  for (int s = 0; s < 4; s++) {
+    d->inDb[s] = 100;
+  }
+  d->hbPeriod = i;
+  d->maxAge = i >> 16;
+}
+
+bool equal(const ConfigData &a, const ConfigData &b) {
+  return memcmp(&a, &b, sizeof(ConfigData)) == 0;
+}
+
+/*
+  Returns the slot whose content differs from the copy, -1 if none
+*/
+int changedSlot(byte (*before)[sizeof(ConfigRecord)]) {
+  for (int s = 0; s < CONFIG_SLOTS; s++) {
+    if (memcmp(before[s], slots[s]->bytes, sizeof(ConfigRecord)) != 0) {
+      return s;
+    }
+  }
+  return -1;
+}
+
+int main() {
+  sim::seed(19);
+  static byte before[CONFIG_SLOTS][sizeof(ConfigRecord)];
+  ConfigData saved, d, loaded;
+  int writes[CONFIG_SLOTS] = {0};
+  int cuts = 0;
+
+  fill(&saved, 0);
+  CHECK(ConfigStore.save(&saved, sizeof(ConfigData), CONFIG_VERSION));
+
+  for (int i = 1; i <= CYCLES; i++) {
+    fill(&d, i);
+    bool cut = sim::rand32() % 2 == 0;
+    if (cut) {
+      sim::powerCut = sim::rand32() % sizeof(ConfigRecord);
+    }
+    for (int s = 0; s < CONFIG_SLOTS; s++) {
+      memcpy(before[s], slots[s]->bytes, sizeof(ConfigRecord));
+    }
+    try {
+      CHECK(ConfigStore.save(&d, sizeof(ConfigData), CONFIG_VERSION));
+      CHECK(!cut);
+    } catch (sim::PowerLoss &) {
+      CHECK(cut);
+      cuts++;
+    }
+    int slot = changedSlot(before);
+    CHECK(slot >= 0);
+    if (slot < 0) {
+      break;
+    }
+
+    // restart
+    memset(&loaded, 0, sizeof(ConfigData));
+    CHECK(ConfigStore.load(&loaded, sizeof(ConfigData)));
+    CHECK_EQ(ConfigStore.version, CONFIG_VERSION);
+    if (!cut) {
+      CHECK(equal(loaded, d));
+    } else {
+      CHECK(equal(loaded, d) || equal(loaded, saved));
+    }
+    if (equal(loaded, d)) {
+      saved = d;
+      writes[slot]++;
+    }
+  }
+  CHECK(cuts > CYCLES / 3);
+
+  // the saves that made it are spread evenly over the slots
+  int least = CYCLES, most = 0;
+  for (int s = 0; s < CONFIG_SLOTS; s++) {
+    least = min(least, writes[s]);
+    most = max(most, writes[s]);
+  }
+  CHECK(most - least <= 1);
+
+  // the sketch starts with the last configuration saved
+  start();
+  CHECK(SerialConfig.isConfigured);
+  CHECK_EQ(SerialConfig.hbPeriod, saved.hbPeriod);
+  CHECK_EQ(SerialConfig.slavesNum, saved.slavesNum);
+
+  // records with a bad CRC, from the newest to the oldest: the previous
+  // ones are loaded in turn
+  ConfigData history[CONFIG_SLOTS];
+  int slotOf[CONFIG_SLOTS];
+  for (int k = 0; k < CONFIG_SLOTS; k++) {
+    fill(&history[k], CYCLES + 1 + k);
+    for (int s = 0; s < CONFIG_SLOTS; s++) {
+      memcpy(before[s], slots[s]->bytes, sizeof(ConfigRecord));
+    }
+    CHECK(ConfigStore.save(&history[k], sizeof(ConfigData), CONFIG_VERSION));
+    slotOf[k] = changedSlot(before);
+  }
+  for (int k = CONFIG_SLOTS - 1; k >= 0; k--) {
+    CHECK(ConfigStore.load(&loaded, sizeof(ConfigData)));
+    CHECK(equal(loaded, history[k]));
+    size_t pos = sim::rand32() % (offsetof(ConfigRecord, data) + sizeof(ConfigData));
+    slots[slotOf[k]]->bytes[pos] ^= 1 << (sim::rand32() % 8);
+  }
+  CHECK(!ConfigStore.load(&loaded, sizeof(ConfigData)));
+
+  return TEST_RESULT();
+}
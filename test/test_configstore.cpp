@@ -0,0 +1,70 @@
+/*
+  Configuration records saved by other versions of the sketch, with
+  fewer or more fields, in the fixed size record
+*/
+
+#include "LoRaBus.cpp"
+#include "Harness.h"
+
+using namespace harness;
+
+int main() {
+  ConfigData d;
+  memset(&d, 0, sizeof(ConfigData));
+  d.address = 1;
+  d.speed = 5;
+  d.parity = 1;
+  d.txPower = 14;
+  d.sf = 7;
+  d.frequency = 869500;
+  d.dc = 100;
+  d.dcWin = 600;
+  memcpy(d.siteId, "abc", 3);
+  memcpy(d.pwd, "16AsciiCharsPwrd", 16);
+  memcpy(d.modes, "DDVI-D", 6);
+  memcpy(d.rules, "----", 4);
+  d.slavesNum = 2;
+  d.slavesAddr[0] = 2;
+  d.slavesAddr[1] = 3;
+  for (int i = 0; i < 4; i++) {
+    d.inDb[i] = 100;
+  }
+  // beyond the length of a record saved before the channels list
+  d.channelsNum = 2;
+  d.channels[0] = 868100;
+  d.channels[1] = 868300;
+  d.rxWindow = 1;
+  CHECK(ConfigStore.save(&d, offsetof(ConfigData, channelsNum), 1));
+
+  start();
+  CHECK(SerialConfig.isConfigured);
+  CHECK(SerialConfig.isGateway);
+  CHECK_EQ(ConfigStore.version, 1);
+  CHECK_EQ(SerialConfig.speed, 5);
+  CHECK_EQ(SerialConfig.slavesNum, 2);
+  CHECK_EQ(SerialConfig.slavesAddr[1], 3);
+  CHECK_EQ(SerialConfig.channelsNum, 0);
+  CHECK_EQ(SerialConfig.channel(), 869500);
+  CHECK_EQ(SerialConfig.rxWindow, LP_DEFAULT_WINDOW);
+  sim::Unit unit(3, 869500);
+  unit.set(DI1, 1);
+  run(1000);
+  CHECK_EQ(read(3, MB_FC_READ_DISCRETE_INPUTS, 101), 1);
+
+  // a record of a later version, with more fields, loads the known ones
+  byte later[CONFIG_DATA_SIZE];
+  memset(later, 0x55, sizeof(later));
+  memcpy(later, &d, sizeof(ConfigData));
+  CHECK(ConfigStore.save(later, sizeof(later), CONFIG_VERSION + 1));
+  ConfigData loaded;
+  memset(&loaded, 0, sizeof(ConfigData));
+  CHECK(ConfigStore.load(&loaded, sizeof(ConfigData)));
+  CHECK_EQ(ConfigStore.version, CONFIG_VERSION + 1);
+  CHECK(memcmp(&loaded, &d, sizeof(ConfigData)) == 0);
+
+  // larger than the record
+  byte tooLong[CONFIG_DATA_SIZE + 1];
+  CHECK(!ConfigStore.save(tooLong, sizeof(tooLong), CONFIG_VERSION));
+
+  return TEST_RESULT();
+}
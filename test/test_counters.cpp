@@ -0,0 +1,86 @@
+/*
+  DI counters of the remote units kept continuous across restarts of the
+  gateway, and the journal entries of the units removed from the
+  configuration dropped, so that the units added in their place are kept
+  continuous too
+*/
+
+#include "LoRaBus.cpp"
+#include "Harness.h"
+
+using namespace harness;
+
+/*
+  Restarts the gateway, running it until initialized
+*/
+void restart() {
+  start();
+  run(10);
+}
+
+void configure(byte slavesNum, const byte *slavesAddr) {
+  ConfigData d;
+  memset(&d, 0, sizeof(ConfigData));
+  d.address = 1;
+  d.speed = 5;
+  d.parity = 1;
+  d.txPower = 14;
+  d.sf = 7;
+  d.frequency = 869500;
+  d.dc = 100;
+  d.dcWin = 600;
+  memcpy(d.siteId, "abc", 3);
+  memcpy(d.pwd, "16AsciiCharsPwrd", 16);
+  memcpy(d.modes, "DDVI-D", 6);
+  memcpy(d.rules, "----", 4);
+  d.slavesNum = slavesNum;
+  memcpy(d.slavesAddr, slavesAddr, slavesNum);
+  for (int s = 0; s < 4; s++) {
+    d.inDb[s] = DEFAULT_DEADBAND;
+  }
+  CHECK(ConfigStore.save(&d, sizeof(ConfigData), CONFIG_VERSION));
+  restart();
+  CHECK(SerialConfig.isConfigured);
+  CHECK(SerialConfig.isGateway);
+  CHECK_EQ(SerialConfig.slavesNum, slavesNum);
+}
+
+void checkpoint() {
+  sim::advance(COUNTERS_SAVE_PERIOD * 1000000ull);
+  run(10);
+}
+
+int main() {
+  // units discovered over time fill the journal
+  configure(0, NULL);
+  CHECK_EQ(Counters.update(2, 0, 50), 50);
+  for (int a = 100; a < 100 + COUNTERS_MAX_UNITS - 1; a++) {
+    Counters.update(a, 0, 10);
+  }
+  CHECK_EQ(Counters.update(3, 0, 40), 40);
+  CHECK_EQ(Counters.update(3, 0, 5), 5);
+  checkpoint();
+
+  // the same units across a restart
+  restart();
+  CHECK_EQ(Counters.value(2, 0), 50);
+  CHECK_EQ(Counters.value(100, 0), 10);
+  CHECK_EQ(Counters.update(2, 0, 3), 53);
+
+  // configured with a list of two units: the others' entries are dropped
+  const byte units[] = {2, 3};
+  configure(2, units);
+  CHECK_EQ(Counters.value(2, 0), 50);
+  CHECK_EQ(Counters.value(100, 0), 0);
+  CHECK_EQ(Counters.update(3, 0, 40), 40);
+  CHECK_EQ(Counters.update(3, 0, 5), 45);
+  checkpoint();
+
+  restart();
+  CHECK_EQ(Counters.value(2, 0), 50);
+  CHECK_EQ(Counters.value(3, 0), 45);
+  CHECK_EQ(Counters.value(100, 0), 0);
+  CHECK_EQ(Counters.update(3, 0, 1), 46);
+
+  return TEST_RESULT();
+}
@@ -0,0 +1,61 @@
+/*
+  Diagnostic counters available without the profiler: registered for the
+  console by the modules keeping them, the watchdog's also readable at
+  register 5300
+*/
+
+#include "LoRaBus.cpp"
+#include "Harness.h"
+
+using namespace harness;
+
+const char *CONFIG =
+  "[GATEWAY]\r\n"
+  "Unit address: 1\r\n"
+  "LoRa frequency: 869500\r\n"
+  "LoRa TX power: 14\r\n"
+  "LoRa spreading factor: 7\r\n"
+  "LoRa duty cycle: 1.00\r\n"
+  "LoRa duty cycle window: 3600\r\n"
+  "Site ID: abc\r\n"
+  "Password: 16AsciiCharsPwrd\r\n"
+  "Input modes: DDVI-D\r\n"
+  "I/O rules: ----\r\n"
+  "Serial speed: 19200\r\n"
+  "Serial parity: Even\r\n"
+  "Remote units: 2\r\n";
+
+int diagnostic(const char *name) {
+  for (int i = 0; i < Diagnostics.num; i++) {
+    if (strcmp(Diagnostics.name(i), name) == 0) {
+      return Diagnostics.read(i);
+    }
+  }
+  return -1;
+}
+
+int main() {
+  CHECK(boot(CONFIG));
+  CHECK(console.find("4. Show diagnostics") != std::string::npos);
+  CHECK_EQ(Diagnostics.num, 4);
+  CHECK_EQ(diagnostic("Watchdog clears close to timeout"), 0);
+  CHECK_EQ(diagnostic("Commands dropped for duty cycle"), 0);
+  CHECK_EQ(diagnostic("Reports sent"), -1);
+
+  // a loop iteration close to the watchdog timeout
+  run(100);
+  sim::advance(WDT_NEAR * 1000ull);
+  run(100);
+  CHECK_EQ(Watchdog.near, 1);
+  CHECK_EQ(diagnostic("Watchdog clears close to timeout"), 1);
+  CHECK_EQ(read(1, MB_FC_READ_INPUT_REGISTER, 5300), 1);
+
+  // the time the MCU idled waiting for an interrupt is not counted
+  run(100);
+  sim::advance(WDT_NEAR * 1000ull);
+  Watchdog.idle(WDT_NEAR);
+  run(100);
+  CHECK_EQ(Watchdog.near, 1);
+
+  return TEST_RESULT();
+}
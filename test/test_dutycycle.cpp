@@ -0,0 +1,72 @@
+/*
+  Gateway commands gated by the duty cycle budget: relay commands are
+  deferred once the whole budget is used, and dropped if held for longer
+  than their retry span
+*/
+
+#include "LoRaBus.cpp"
+#include "Harness.h"
+
+using namespace harness;
+
+const char *CONFIG =
+  "[GATEWAY]\r\n"
+  "Unit address: 1\r\n"
+  "LoRa frequency: 869500\r\n"
+  "LoRa TX power: 14\r\n"
+  "LoRa spreading factor: 7\r\n"
+  "LoRa duty cycle: 0.10\r\n"
+  "LoRa duty cycle window: 600\r\n"
+  "Site ID: abc\r\n"
+  "Password: 16AsciiCharsPwrd\r\n"
+  "Input modes: DDVI-D\r\n"
+  "I/O rules: ----\r\n"
+  "Serial speed: 19200\r\n"
+  "Serial parity: Even\r\n"
+  "Remote units: 2\r\n";
+
+int main() {
+  CHECK(boot(CONFIG));
+  sim::Unit unit(2, 869500);
+  unit.report();
+  run(1000);
+
+  // budget of 600ms per 600s window
+  int writes = 0;
+  while (read(1, MB_FC_READ_INPUT_REGISTER, 5204) == 0 && writes < 100) {
+    int on = ++writes % 2;
+    CHECK_EQ(write(2, MB_FC_WRITE_SINGLE_COIL, 1, on), 0);
+    runUntil([&]() { return unit.state.get(DO1) == on; }, 5000);
+    run(1000);
+  }
+  CHECK(writes < 100);
+  CHECK_EQ(read(1, MB_FC_READ_INPUT_REGISTER, 5201), 600 - writes * DutyCycle.timeOnAir(7, DC_CMD_LEN) + DutyCycle.timeOnAir(7, DC_CMD_LEN));
+  CHECK_EQ(read(2, MB_FC_READ_INPUT_REGISTER, 5401), CMD_PENDING);
+
+  // held until the retry span is over, never reaching the library's limit
+  run(CMD_RETRY_SPAN + 2000);
+  CHECK_EQ(read(2, MB_FC_READ_INPUT_REGISTER, 5401), CMD_FAILED);
+  CHECK_EQ(read(1, MB_FC_READ_INPUT_REGISTER, 5205), 1);
+  // counted once per command, not on every check
+  CHECK_EQ(read(1, MB_FC_READ_INPUT_REGISTER, 5204), 1);
+  CHECK_EQ(LoRaNet.held, 0);
+
+  // AO1 held while the budget left is reserved, counted once
+  CHECK_EQ(write(2, MB_FC_WRITE_SINGLE_REGISTER, 601, 5000), 0);
+  run(10000);
+  CHECK_EQ(read(2, MB_FC_READ_INPUT_REGISTER, 5402), CMD_AO);
+  CHECK_EQ(read(1, MB_FC_READ_INPUT_REGISTER, 5203), 1);
+  CHECK_EQ(write(2, MB_FC_WRITE_SINGLE_REGISTER, 601, 6000), 0);
+  run(10000);
+  CHECK_EQ(read(1, MB_FC_READ_INPUT_REGISTER, 5203), 2);
+  CHECK_EQ(LoRaNet.held, 0);
+
+  // sent in the next window
+  run(read(1, MB_FC_READ_INPUT_REGISTER, 5202) * 1000ul);
+  int on = (writes + 1) % 2;
+  CHECK_EQ(write(2, MB_FC_WRITE_SINGLE_COIL, 1, on), 0);
+  CHECK(runUntil([&]() { return unit.state.get(DO1) == on; }, 5000));
+  CHECK_EQ(LoRaNet.held, 0);
+
+  return TEST_RESULT();
+}
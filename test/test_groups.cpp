@@ -0,0 +1,55 @@
+/*
+  Group requests on a gateway of a multi-gateway site that is not the
+  group responder: only its units are written, nothing is answered
+*/
+
+#include "LoRaBus.cpp"
+#include "Harness.h"
+
+using namespace harness;
+
+const char *CONFIG =
+  "[GATEWAY]\r\n"
+  "Unit address: 1\r\n"
+  "LoRa frequency: 869500\r\n"
+  "LoRa TX power: 14\r\n"
+  "LoRa spreading factor: 7\r\n"
+  "LoRa duty cycle: 10.00\r\n"
+  "LoRa duty cycle window: 600\r\n"
+  "Site ID: abc\r\n"
+  "Password: 16AsciiCharsPwrd\r\n"
+  "Input modes: DDVI-D\r\n"
+  "I/O rules: ----\r\n"
+  "Serial speed: 19200\r\n"
+  "Serial parity: Even\r\n"
+  "Remote units: 2, 3\r\n"
+  "Group 1 address: 100\r\n"
+  "Group 1 units: 2, 3\r\n"
+  "Other gateways frequencies: 868100\r\n";
+
+int main() {
+  CHECK(boot(CONFIG));
+  CHECK(!SerialConfig.isGroupResponder());
+  sim::Unit unit2(2, 869500);
+  sim::Unit unit3(3, 869500);
+  unit2.report();
+  run(500);
+  unit3.report();
+  run(500);
+
+  CHECK_EQ(read(100, MB_FC_READ_COILS, 1), NO_RESPONSE);
+  CHECK_EQ(read(100, MB_FC_READ_INPUT_REGISTER, 201), NO_RESPONSE);
+  CHECK_EQ(write(100, 0x08, 0, 0), NO_RESPONSE);
+  CHECK_EQ(write(100, MB_FC_WRITE_SINGLE_COIL, 99, 1), NO_RESPONSE);
+  CHECK_EQ(write(100, MB_FC_WRITE_SINGLE_REGISTER, 9999, 1), NO_RESPONSE);
+
+  CHECK_EQ(write(100, MB_FC_WRITE_SINGLE_COIL, 1, 1), NO_RESPONSE);
+  CHECK(runUntil([&]() { return unit2.state.get(DO1) == 1 && unit3.state.get(DO1) == 1; }, 10000));
+
+  // the gateway's own units still answer
+  CHECK_EQ(write(2, 0x08, 0, 0), -MB_EX_ILLEGAL_FUNCTION);
+  CHECK_EQ(read(2, MB_FC_READ_INPUT_REGISTER, 9999), -MB_EX_ILLEGAL_DATA_ADDRESS);
+  CHECK_EQ(write(2, MB_FC_WRITE_SINGLE_COIL, 2, 1), 0);
+
+  return TEST_RESULT();
+}
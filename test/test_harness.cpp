@@ -0,0 +1,73 @@
+/*
+  Gateway and simulated remote units exchanging frames on the simulated
+  channel, driven from the Modbus side
+*/
+
+#include "LoRaBus.cpp"
+#include "Harness.h"
+
+using namespace harness;
+
+const char *CONFIG =
+  "[GATEWAY]\r\n"
+  "Unit address: 1\r\n"
+  "LoRa frequency: 869500\r\n"
+  "LoRa TX power: 14\r\n"
+  "LoRa spreading factor: 7\r\n"
+  "LoRa duty cycle: 10.00\r\n"
+  "LoRa duty cycle window: 600\r\n"
+  "Site ID: abc\r\n"
+  "Password: 16AsciiCharsPwrd\r\n"
+  "Input modes: DDVI-D\r\n"
+  "I/O rules: FI--\r\n"
+  "Serial speed: 19200\r\n"
+  "Serial parity: Even\r\n"
+  "Remote units: 2, 3\r\n";
+
+int main() {
+  boot(CONFIG);
+  CHECK(SerialConfig.isConfigured);
+  CHECK(SerialConfig.isGateway);
+  CHECK_EQ(SerialConfig.slavesNum, 2);
+
+  sim::Unit unit2(2, 869500);
+  sim::Unit unit3(3, 869500);
+
+  // no state received yet
+  CHECK_EQ(read(2, MB_FC_READ_INPUT_REGISTER, 5101), 0xFFFF);
+  CHECK_EQ(read(4, MB_FC_READ_INPUT_REGISTER, 5101), NO_RESPONSE);
+  CHECK_EQ(read(1, MB_FC_READ_INPUT_REGISTER, 99), ID_NUMBER_GW);
+
+  unit2.set(DI1, 1);
+  unit2.set(AV1, 2.5);
+  run(200);
+  unit3.set(DI2, 1);
+  run(1000);
+  CHECK_EQ(read(2, MB_FC_READ_DISCRETE_INPUTS, 101), 1);
+  CHECK_EQ(read(2, MB_FC_READ_INPUT_REGISTER, 201), 2500);
+  CHECK_EQ(read(2, MB_FC_READ_INPUT_REGISTER, 1001), 1);
+  CHECK_EQ(read(3, MB_FC_READ_DISCRETE_INPUTS, 102), 1);
+  CHECK_EQ(read(3, MB_FC_READ_DISCRETE_INPUTS, 101), 0);
+  CHECK_EQ(read(2, MB_FC_READ_INPUT_REGISTER, 5001), (word) sim::channel.rssi);
+
+  // write to relay delivered and confirmed by the unit's state update
+  CHECK_EQ(write(2, MB_FC_WRITE_SINGLE_COIL, 2, 1), 0);
+  CHECK(runUntil([&]() { return unit2.state.get(DO2) == 1; }, 2000));
+  CHECK(runUntil([&]() { return read(2, MB_FC_READ_INPUT_REGISTER, 5401) == CMD_IDLE; }, 2000));
+  CHECK_EQ(read(2, MB_FC_READ_COILS, 2), 1);
+  CHECK_EQ(write(2, MB_FC_WRITE_SINGLE_REGISTER, 601, 5000), 0);
+  CHECK(runUntil([&]() { return unit2.state.get(AO1) == 5; }, 5000));
+
+  // with latency and losses commands are retried until confirmed
+  sim::channel.latencyMs = 50;
+  sim::channel.loss = 0.2;
+  for (int i = 0; i < 10; i++) {
+    CHECK_EQ(write(3, MB_FC_WRITE_SINGLE_COIL, 1, i % 2), 0);
+    CHECK(runUntil([&]() { return unit3.state.get(DO1) == i % 2; }, 200000));
+    CHECK(runUntil([&]() { return read(3, MB_FC_READ_INPUT_REGISTER, 5401) == CMD_IDLE; }, 200000));
+  }
+  CHECK(sim::channel.lost > 0);
+  sim::channel.loss = 0;
+
+  return TEST_RESULT();
+}
@@ -0,0 +1,215 @@
+/*
+  Import of the README's example configurations through the console:
+  the parsed values, no heap allocation while the sketch runs the
+  console and no per-character delay, and the values out of the limits
+  of the wizard rejected. Prints the parse time as JSON.
+  Run once per example, the remote unit's when given "remote".
+*/
+
+#include <chrono>
+#include <fstream>
+#include <new>
+#include "LoRaBus.cpp"
+#include "Harness.h"
+
+using namespace harness;
+
+static bool counting = false;
+static unsigned long allocs = 0;
+static size_t allocBytes = 0;
+
+void *operator new(size_t size) {
+  if (counting) {
+    allocs++;
+    allocBytes += size;
+  }
+  void *p = malloc(size);
+  if (p == NULL) {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+
+void *operator new[](size_t size) {
+  return operator new(size);
+}
+
+void operator delete(void *p) noexcept {
+  free(p);
+}
+
+void operator delete[](void *p) noexcept {
+  free(p);
+}
+
+void operator delete(void *p, size_t) noexcept {
+  free(p);
+}
+
+void operator delete[](void *p, size_t) noexcept {
+  free(p);
+}
+
+/*
+  Returns the code block following the given title in the README, with
+  the lines terminated by CR LF as pasted in a terminal
+*/
+std::string example(const std::string &title) {
+  std::ifstream f(README_PATH);
+  std::string line, block;
+  bool found = false, in = false;
+  while (std::getline(f, line)) {
+    if (!found) {
+      found = line.find(title) != std::string::npos;
+    } else if (line.compare(0, 3, "```") == 0) {
+      if (in) {
+        break;
+      }
+      in = true;
+    } else if (in) {
+      block += line + "\r\n";
+    }
+  }
+  return block;
+}
+
+/*
+  Returns the configuration with the line of the given key replaced, or
+  added if missing
+*/
+std::string with(const std::string &config, const std::string &key, const std::string &value) {
+  std::string line = key + ": " + value + "\r\n";
+  size_t p = config.find(key + ":");
+  if (p == std::string::npos) {
+    return config + line;
+  }
+  return config.substr(0, p) + line + config.substr(config.find("\n", p) + 1);
+}
+
+/*
+  Imports the configuration as boot() does, counting the allocations and
+  the time spent in the sketch
+*/
+bool import(const std::string &config, const char *name) {
+  const unsigned long yesMs = 2000;
+  Serial.input("     ");
+  Serial.input("2\r\n", 200);
+  Serial.input(config.c_str(), 400);
+  Serial.input("\r\nY\r\n", yesMs);
+  Serial.output.reserve(1 << 16);
+
+  bool saved = false;
+  unsigned long long simStart = sim::nowUs;
+  auto t0 = std::chrono::steady_clock::now();
+  allocs = 0;
+  allocBytes = 0;
+  counting = true;
+  try {
+    setup();
+  } catch (sim::Reset &) {
+    saved = true;
+  } catch (sim::InputExhausted &) {
+  }
+  counting = false;
+  auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now() - t0).count();
+  unsigned long long simUs = sim::nowUs - simStart;
+
+  printf("{\"config\": \"%s\", \"bytes\": %d, \"host_ns\": %lld, \"sim_ms\": %llu, "
+      "\"allocs\": %lu, \"alloc_bytes\": %zu}\n",
+      name, (int) config.size(), (long long) ns, simUs / 1000, allocs, allocBytes);
+
+  CHECK_EQ(allocs, 0);
+  // the text is parsed as it is received: the import ends within the
+  // read timeout of its last character, before the confirmation arrives,
+  // and the sketch resets one second after saving
+  CHECK(simUs < (yesMs + 1000 + 500) * 1000ull);
+
+  console = Serial.output;
+  Serial.clear();
+  if (saved) {
+    start();
+  }
+  return saved;
+}
+
+void checkRemote() {
+  std::string remote = example("**Remote unit configuration example:**");
+  CHECK(remote.compare(0, 13, "[REMOTE UNIT]") == 0);
+
+  CHECK(!boot(with(remote, "Input 1 updates interval", "65536").c_str()));
+  CHECK(!boot(with(remote, "Input 1 deadband", "0").c_str()));
+  CHECK(!boot(with(remote, "Input 1 deadband", "70000").c_str()));
+  CHECK(!boot(with(remote, "Heartbeat period", "5").c_str()));
+  CHECK(!boot(with(remote, "Heartbeat period", "70000").c_str()));
+  CHECK(!boot(with(remote, "Aggregation delay", "10001").c_str()));
+  CHECK(!boot(with(remote, "Receive windows period", "121").c_str()));
+  CHECK(!boot(with(remote, "Receive window length", "0").c_str()));
+  CHECK(!boot(with(remote, "Receive window length", "65636").c_str()));
+  CHECK(!SerialConfig.isConfigured);
+
+  CHECK(import(remote, "remote"));
+  CHECK(SerialConfig.isConfigured);
+  CHECK(!SerialConfig.isGateway);
+  CHECK_EQ(SerialConfig.address, 2);
+  CHECK_EQ(SerialConfig.frequency, 869500);
+  CHECK_EQ(SerialConfig.txPower, 14);
+  CHECK_EQ(SerialConfig.sf, 7);
+  CHECK_EQ(SerialConfig.dc, 100);
+  CHECK_EQ(SerialConfig.dcWin, 600);
+  CHECK(strcmp((char *) SerialConfig.siteId, "abc") == 0);
+  CHECK(strcmp((char *) SerialConfig.pwd, "16AsciiCharsPwrd") == 0);
+  CHECK(strcmp(SerialConfig.modes, "VDDI--") == 0);
+  CHECK(strcmp(SerialConfig.rules, "-LT-") == 0);
+  CHECK_EQ(SerialConfig.inItvl[0], 5);
+  CHECK_EQ(SerialConfig.inItvl[3], 5);
+  CHECK_EQ(SerialConfig.inItvl[4], 0);
+  CHECK_EQ(SerialConfig.inDb[0], 100);
+  CHECK_EQ(SerialConfig.inDb[1], DEFAULT_DEADBAND);
+  CHECK_EQ(SerialConfig.inDb[3], 200);
+  CHECK_EQ(SerialConfig.hbPeriod, 3600);
+  CHECK_EQ(SerialConfig.aggrDelay, 500);
+  CHECK_EQ(SerialConfig.rxPeriod, 0);
+}
+
+void checkGateway() {
+  std::string gateway = example("**Gateway unit configuration example:**");
+  CHECK(gateway.compare(0, 9, "[GATEWAY]") == 0);
+
+  CHECK(!boot(with(gateway, "Max state age", "65535").c_str()));
+  CHECK(!boot(with(gateway, "LoRa channels", "8681").c_str()));
+  CHECK(!boot(with(gateway, "LoRa channels",
+      "868100, 868300, 868500, 868700, 868900, 869100, 869300, 869500, 869700").c_str()));
+  CHECK(!SerialConfig.isConfigured);
+
+  CHECK(import(gateway, "gateway"));
+  CHECK(SerialConfig.isConfigured);
+  CHECK(SerialConfig.isGateway);
+  CHECK_EQ(SerialConfig.address, 1);
+  CHECK_EQ(SerialConfig.frequency, 869500);
+  CHECK_EQ(SerialConfig.dc, 100);
+  CHECK(strcmp(SerialConfig.modes, "DDVI-D") == 0);
+  CHECK(strcmp(SerialConfig.rules, "FI--") == 0);
+  CHECK_EQ(SPEEDS[SerialConfig.speed], 19200);
+  CHECK_EQ(SerialConfig.parity, 1);
+  CHECK_EQ(SerialConfig.slavesNum, 2);
+  CHECK_EQ(SerialConfig.slavesAddr[0], 2);
+  CHECK_EQ(SerialConfig.slavesAddr[1], 3);
+  CHECK_EQ(SerialConfig.groupsAddr[0], 100);
+  CHECK(SerialConfig.inGroup(0, 2));
+  CHECK(SerialConfig.inGroup(0, 3));
+  CHECK(!SerialConfig.inGroup(0, 4));
+  CHECK_EQ(SerialConfig.peersNum, 1);
+  CHECK_EQ(SerialConfig.peersFreq[0], 868100);
+  CHECK_EQ(SerialConfig.maxAge, 0);
+}
+
+int main(int argc, char **argv) {
+  // the console opens only after a reset: one import per run
+  if (argc > 1 && strcmp(argv[1], "remote") == 0) {
+    checkRemote();
+  } else {
+    checkGateway();
+  }
+  return TEST_RESULT();
+}
@@ -0,0 +1,102 @@
+/*
+  Configuration saved in the emulated EEPROM by the previous firmware,
+  migrated to a record at startup, and a save that does not take on a
+  worn flash reported as an error
+*/
+
+#include "LoRaBus.cpp"
+#include "Harness.h"
+
+using namespace harness;
+
+const char *CONFIG =
+  "[GATEWAY]\r\n"
+  "Unit address: 1\r\n"
+  "LoRa frequency: 869500\r\n"
+  "LoRa TX power: 14\r\n"
+  "LoRa spreading factor: 7\r\n"
+  "LoRa duty cycle: 10.00\r\n"
+  "LoRa duty cycle window: 600\r\n"
+  "Site ID: abc\r\n"
+  "Password: 16AsciiCharsPwrd\r\n"
+  "Input modes: DDVI-D\r\n"
+  "I/O rules: ----\r\n"
+  "Serial speed: 19200\r\n"
+  "Serial parity: Even\r\n"
+  "Remote units: 2, 3\r\n";
+
+void put16(byte *mem, int a, uint16_t v) {
+  mem[a] = v & 0xFF;
+  mem[a + 1] = v >> 8;
+}
+
+/*
+  Writes the 56 bytes block of the previous firmware and its remote units
+  list
+*/
+void writeEeprom() {
+  byte mem[55];
+  memset(mem, 0, sizeof(mem));
+  mem[0] = 1;
+  mem[1] = 5;
+  mem[2] = 1;
+  put16(mem, 3, 869500 & 0xFFFF);
+  put16(mem, 5, 869500 >> 16);
+  mem[7] = 14;
+  mem[8] = 7;
+  put16(mem, 9, 100);
+  put16(mem, 11, 600);
+  memcpy(mem + 13, "abc", 3);
+  memcpy(mem + 16, "16AsciiCharsPwrd", 16);
+  memcpy(mem + 32, "DDVI-D", 6);
+  memcpy(mem + 50, "----", 4);
+  mem[54] = 2;
+  byte checksum = 7;
+  for (int a = 0; a < 55; a++) {
+    EEPROM.write(a, mem[a]);
+    checksum ^= mem[a];
+  }
+  EEPROM.write(55, checksum);
+  EEPROM.write(56, 2);
+  EEPROM.write(57, 3);
+  // leftovers of development builds past the block, with valid
+  // checksums, not part of any released layout
+  for (int a = 58; a < EEPROM_EMULATION_SIZE; a++) {
+    EEPROM.write(a, 0x64);
+  }
+  EEPROM.write(304 + 12, 7);
+  EEPROM.write(320 + 4 * 33, 7);
+  EEPROM.commit();
+}
+
+int main() {
+  sim::flashWorn = true;
+  CHECK(!boot(CONFIG));
+  CHECK(console.find("Saving...\r\nError") != std::string::npos);
+  CHECK(console.find("Saved!") == std::string::npos);
+  CHECK(!SerialConfig.isConfigured);
+  sim::flashWorn = false;
+
+  writeEeprom();
+  start();
+  CHECK(SerialConfig.isConfigured);
+  CHECK(SerialConfig.isGateway);
+  CHECK_EQ(SerialConfig.address, 1);
+  CHECK_EQ(SerialConfig.frequency, 869500);
+  CHECK_EQ(SerialConfig.dc, 100);
+  CHECK(strcmp((char *) SerialConfig.pwd, "16AsciiCharsPwrd") == 0);
+  CHECK_EQ(SerialConfig.slavesNum, 2);
+  CHECK_EQ(SerialConfig.slavesAddr[1], 3);
+  CHECK_EQ(SerialConfig.inDb[0], DEFAULT_DEADBAND);
+  CHECK_EQ(SerialConfig.groupsAddr[0], 0);
+  CHECK(!SerialConfig.inGroup(0, 2));
+
+  // saved as a record, loaded from it at the next start
+  CHECK_EQ(ConfigStore.seq, 1);
+  ConfigData d;
+  CHECK(ConfigStore.load(&d, sizeof(ConfigData)));
+  CHECK_EQ(d.frequency, 869500);
+  CHECK_EQ(d.slavesNum, 2);
+
+  return TEST_RESULT();
+}
@@ -0,0 +1,61 @@
+/*
+  Loop profiler: each stage run in a loop iteration is recorded once,
+  also when run more than once, and the gateway's background work is
+  split in its own stages
+*/
+
+#include "LoRaBus.cpp"
+#include "Harness.h"
+
+using namespace harness;
+
+const char *CONFIG =
+  "[GATEWAY]\r\n"
+  "Unit address: 1\r\n"
+  "LoRa frequency: 869500\r\n"
+  "LoRa TX power: 14\r\n"
+  "LoRa spreading factor: 7\r\n"
+  "LoRa duty cycle: 1.00\r\n"
+  "LoRa duty cycle window: 3600\r\n"
+  "Site ID: abc\r\n"
+  "Password: 16AsciiCharsPwrd\r\n"
+  "Input modes: DDVI-D\r\n"
+  "I/O rules: ----\r\n"
+  "Serial speed: 19200\r\n"
+  "Serial parity: Even\r\n"
+  "Remote units: 2\r\n";
+
+unsigned long recorded(int s) {
+  unsigned long n = 0;
+  for (int b = 0; b < PRF_BUCKETS; b++) {
+    n += Profiler.histogram[s][b];
+  }
+  return n;
+}
+
+int main() {
+  CHECK(boot(CONFIG));
+  sim::Unit unit(2, 869500);
+  unit.report();
+  run(1000);
+  CHECK_EQ(read(2, MB_FC_READ_INPUT_REGISTER, 5101), 0);
+
+  memset(Profiler.histogram, 0, sizeof(Profiler.histogram));
+  for (int i = 0; i < 1000; i++) {
+    step();
+  }
+  CHECK_EQ(recorded(PRF_LOOP), 1000);
+  CHECK_EQ(recorded(PRF_LORA), 1000);
+  CHECK_EQ(recorded(PRF_MODBUS), 1000);
+  CHECK_EQ(recorded(PRF_IMAGE), 1000);
+  CHECK_EQ(recorded(PRF_CMDS), 1000);
+  CHECK_EQ(recorded(PRF_COUNTERS), 1000);
+  CHECK_EQ(recorded(PRF_CONFIG), 0);
+
+  CHECK(read(1, MB_FC_READ_INPUT_REGISTER, 5360) >= 0);
+  CHECK(read(1, MB_FC_READ_INPUT_REGISTER, 5388) >= 0);
+  CHECK_EQ(read(1, MB_FC_READ_INPUT_REGISTER, 5390), -MB_EX_ILLEGAL_DATA_ADDRESS);
+  CHECK_EQ(sizeof(PRF_NAMES) / sizeof(PRF_NAMES[0]), PRF_STAGES);
+
+  return TEST_RESULT();
+}
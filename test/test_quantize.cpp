@@ -0,0 +1,121 @@
+/*
+  Analog values quantized to the deadband by a remote unit: the value
+  seen by the gateway never lags the input by more than the deadband,
+  and quantized values read back exactly through the registers scaling.
+  The same random walk is then reported plain, by an input subscribed
+  with the deadband as min variation and no step, and quantized: prints
+  the reports sent and their time-on-air as JSON.
+*/
+
+#include "LoRaBus.cpp"
+#include "Harness.h"
+
+using namespace harness;
+
+const char *CONFIG =
+  "[REMOTE UNIT]\r\n"
+  "Unit address: 2\r\n"
+  "LoRa frequency: 869500\r\n"
+  "LoRa TX power: 14\r\n"
+  "LoRa spreading factor: 7\r\n"
+  "LoRa duty cycle: 10.00\r\n"
+  "LoRa duty cycle window: 600\r\n"
+  "Site ID: abc\r\n"
+  "Password: 16AsciiCharsPwrd\r\n"
+  "Input modes: V-DD--\r\n"
+  "I/O rules: ----\r\n"
+  "Input 1 updates interval: 0\r\n"
+  "Input 2 updates interval: 0\r\n"
+  "Input 3 updates interval: 0\r\n"
+  "Input 4 updates interval: 0\r\n"
+  "Input 5 updates interval: 0\r\n"
+  "Input 6 updates interval: 0\r\n"
+  "Input 1 deadband: 100\r\n"
+  "Heartbeat period: 0\r\n"
+  "Aggregation delay: 0\r\n"
+  "Receive windows period: 0\r\n";
+
+const float DEADBAND = 0.1;
+const int WALK_STEPS = 500;
+
+struct Airtime {
+  unsigned long sent;
+  unsigned long long txUs;
+};
+
+/*
+  Drives the input with a random walk in steps below the deadband, each
+  value held long enough for its update to be sent. Returns the reports
+  sent and their time-on-air.
+*/
+Airtime walk(uint8_t pin, unsigned long seed) {
+  sim::seed(seed);
+  word sent = Reports.sent;
+  unsigned long long txUs = LoRa.radio.txUs;
+  float v = 5;
+  for (int i = 0; i < WALK_STEPS; i++) {
+    v = min(max(v + ((long) (sim::rand32() % 121) - 60) / 1000.0f, 0.0f), 10.0f);
+    Iono.set(pin, v);
+    run(400);
+  }
+  return {(word) (Reports.sent - sent), LoRa.radio.txUs - txUs};
+}
+
+int main() {
+  for (int mv = 0; mv <= 10000; mv += 100) {
+    CHECK_EQ(analogToRegister(((long) (mv / 1000.0 / DEADBAND + 0.5)) * DEADBAND, 1000), mv);
+  }
+
+  Iono.set(AV1, 5);
+  CHECK(boot(CONFIG));
+  sim::Gateway gateway(869500);
+  Iono.set(AV1, 5.26);
+  run(500);
+  CHECK(gateway.states.count(2) > 0);
+  CHECK_EQ(analogToRegister(gateway.states[2].get(AV1), 1000), 5300);
+
+  // random walk in steps below the deadband, each value held long enough
+  // for its update to be sent
+  float v = 5.26;
+  int lagging = 0;
+  for (int i = 0; i < 500; i++) {
+    v = min(max(v + ((long) (sim::rand32() % 121) - 60) / 1000.0f, 0.0f), 10.0f);
+    Iono.set(AV1, v);
+    run(400);
+    float reported = gateway.states[2].get(AV1);
+    if (fabs(reported - v) > DEADBAND + 0.0001) {
+      lagging++;
+    }
+    CHECK(fabs(reported / DEADBAND - lround(reported / DEADBAND)) < 0.001);
+  }
+  CHECK_EQ(lagging, 0);
+
+  // moves of less than the deadband from the reported value are not sent
+  unsigned long updates = gateway.updates[2];
+  Iono.set(AV1, 3.02);
+  run(400);
+  CHECK_EQ(gateway.updates[2], updates + 1);
+  for (int i = 0; i < 10; i++) {
+    Iono.set(AV1, 3.02 + (i % 2 ? 0.02 : -0.02));
+    run(400);
+  }
+  CHECK_EQ(gateway.updates[2], updates + 1);
+  CHECK_EQ(analogToRegister(gateway.states[2].get(AV1), 1000), 3000);
+
+  // the same walk reported plain, as before the quantization, and
+  // quantized
+  Iono.set(AV2, 5);
+  Iono.subscribeAnalog(AV2, DELAY, DEADBAND, &Reports::subscribeCallback);
+  run(500);
+  Airtime plain = walk(AV2, 7);
+  Airtime quantized = walk(AV1, 7);
+  printf("{\"steps\": %d, \"plain_sent\": %lu, \"plain_airtime_ms\": %llu, "
+      "\"quantized_sent\": %lu, \"quantized_airtime_ms\": %llu}\n",
+      WALK_STEPS, plain.sent, plain.txUs / 1000, quantized.sent, quantized.txUs / 1000);
+  // rounding costs no extra reports and leaves the frames' length as is
+  CHECK(plain.sent > 0);
+  CHECK(quantized.sent <= plain.sent + plain.sent / 10);
+  CHECK_EQ(quantized.txUs * plain.sent, plain.txUs * quantized.sent);
+
+  return TEST_RESULT();
+}
@@ -0,0 +1,141 @@
+/*
+  Remote unit registers table against the README's registers table: each
+  register documented for the remote units is in the table with the
+  documented functions and scaling, and nothing else is, both in the
+  table lookup and in the answers of the Modbus handler
+*/
+
+#include <fstream>
+#include <set>
+#include "LoRaBus.cpp"
+#include "Harness.h"
+
+using namespace harness;
+
+const char *CONFIG =
+  "[GATEWAY]\r\n"
+  "Unit address: 1\r\n"
+  "LoRa frequency: 869500\r\n"
+  "LoRa TX power: 14\r\n"
+  "LoRa spreading factor: 7\r\n"
+  "LoRa duty cycle: 1.00\r\n"
+  "LoRa duty cycle window: 3600\r\n"
+  "Site ID: abc\r\n"
+  "Password: 16AsciiCharsPwrd\r\n"
+  "Input modes: DDVI-D\r\n"
+  "I/O rules: ----\r\n"
+  "Serial speed: 19200\r\n"
+  "Serial parity: Even\r\n"
+  "Remote units: 2\r\n";
+
+const byte FUNCTIONS[] = {1, 2, 3, 4, 5, 6, 15, 16};
+
+struct Documented {
+  word first;
+  word last;
+  std::set<int> functions;
+  std::string unit;
+};
+
+std::vector<std::string> cells(const std::string &line) {
+  std::vector<std::string> c;
+  size_t start = 1;
+  size_t end;
+  while ((end = line.find('|', start)) != std::string::npos) {
+    c.push_back(line.substr(start, end - start));
+    start = end + 1;
+  }
+  return c;
+}
+
+// rows of the registers table not marked as of the gateway only
+std::vector<Documented> remoteRegisters() {
+  std::vector<Documented> regs;
+  std::ifstream readme(README_PATH);
+  std::string line;
+  while (std::getline(readme, line)) {
+    if (line.size() < 2 || line[0] != '|' || !isdigit(line[1])) {
+      continue;
+    }
+    std::vector<std::string> c = cells(line);
+    if (c.size() < 7 || c[6].find("(gateway only)") != std::string::npos) {
+      continue;
+    }
+    Documented d;
+    d.first = atoi(c[0].c_str());
+    size_t dash = c[0].find('-');
+    d.last = dash == std::string::npos ? d.first : atoi(c[0].c_str() + dash + 1);
+    for (const char *f = c[2].c_str(); *f != '\0'; f += strcspn(f, ",") + (f[strcspn(f, ",")] == ',')) {
+      d.functions.insert(atoi(f));
+    }
+    d.unit = c[5];
+    regs.push_back(d);
+  }
+  return regs;
+}
+
+bool isRead(byte function) {
+  return function <= MB_FC_READ_INPUT_REGISTER;
+}
+
+int main() {
+  std::vector<Documented> regs = remoteRegisters();
+  CHECK(regs.size() > 30);
+
+  std::set<word> documented;
+  for (const Documented &d : regs) {
+    for (word a = d.first; a <= d.last; a++) {
+      documented.insert(a);
+      for (byte f : FUNCTIONS) {
+        const RegisterRange *r = RegisterMap.find(f, a, 1);
+        if ((r != NULL) != (d.functions.count(f) > 0)) {
+          fprintf(stderr, "register %u function %u\n", a, f);
+          CHECK(false);
+        }
+        if (r != NULL) {
+          bool scaled = d.unit == "mV" || d.unit == "µA" || d.unit == "dB/1000";
+          CHECK_EQ(r->scale, scaled ? 1000 : 1);
+        }
+      }
+    }
+    // multi-word values are read in one request
+    CHECK(RegisterMap.find(*d.functions.begin(), d.first, d.last - d.first + 1) != NULL);
+  }
+  for (const RegisterRange &r : REGISTERS) {
+    for (word a = r.first; a <= r.last; a++) {
+      if (documented.count(a) == 0) {
+        fprintf(stderr, "register %u not documented\n", a);
+        CHECK(false);
+      }
+    }
+  }
+
+  // the Modbus handler answers the reads of the documented registers
+  // only, with the documented functions only
+  CHECK(boot(CONFIG));
+  sim::Unit unit(2, 869500);
+  unit.report();
+  run(400);
+  for (word a = 1; a < 6000; a++) {
+    for (byte f : FUNCTIONS) {
+      if (!isRead(f)) {
+        continue;
+      }
+      bool listed = false;
+      for (const Documented &d : regs) {
+        listed = listed || (a >= d.first && a <= d.last && d.functions.count(f) > 0);
+      }
+      if (!listed && RegisterMap.find(f, a, 1) == NULL && (a % 97 != 0)) {
+        // sampled, most of the address space is not mapped
+        continue;
+      }
+      long res = read(2, f, a);
+      if ((res >= 0) != listed) {
+        fprintf(stderr, "register %u function %u: %ld\n", a, f, res);
+        CHECK(false);
+      }
+    }
+  }
+
+  return TEST_RESULT();
+}
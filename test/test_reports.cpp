@@ -0,0 +1,73 @@
+/*
+  Remote unit reports held while another unit is transmitting: the
+  backoff is counted and the report goes out once the channel is free
+*/
+
+#include "LoRaBus.cpp"
+#include "Harness.h"
+
+using namespace harness;
+
+const char *CONFIG =
+  "[REMOTE UNIT]\r\n"
+  "Unit address: 2\r\n"
+  "LoRa frequency: 869500\r\n"
+  "LoRa TX power: 14\r\n"
+  "LoRa spreading factor: 7\r\n"
+  "LoRa duty cycle: 10.00\r\n"
+  "LoRa duty cycle window: 600\r\n"
+  "Site ID: abc\r\n"
+  "Password: 16AsciiCharsPwrd\r\n"
+  "Input modes: DDDD--\r\n"
+  "I/O rules: ----\r\n"
+  "Input 1 updates interval: 0\r\n"
+  "Input 2 updates interval: 0\r\n"
+  "Input 3 updates interval: 0\r\n"
+  "Input 4 updates interval: 0\r\n"
+  "Input 5 updates interval: 0\r\n"
+  "Input 6 updates interval: 0\r\n"
+  "Heartbeat period: 0\r\n"
+  "Aggregation delay: 0\r\n"
+  "Receive windows period: 0\r\n";
+
+int diagnostic(const char *name) {
+  for (int i = 0; i < Diagnostics.num; i++) {
+    if (strcmp(Diagnostics.name(i), name) == 0) {
+      return Diagnostics.read(i);
+    }
+  }
+  return -1;
+}
+
+int main() {
+  CHECK(boot(CONFIG));
+  sim::Gateway gateway(869500);
+  sim::Unit other(3, 869500);
+  run(2000);
+  CHECK_EQ(Reports.deferred, 0);
+
+  // the first state waited for the startup backoff of unit 2, two slots
+  // and a random part of one
+  unsigned long slot = DutyCycle.timeOnAir(7, DC_CMD_LEN);
+  CHECK(Reports.delayMax >= 2 * slot - DELAY);
+  CHECK(Reports.delayMax <= 3 * slot);
+  Reports.delayMax = 0;
+
+  // DI1 changes while unit 3 sends its state
+  other.report();
+  unsigned long long busyUs = sim::timeOnAirUs(7, sim::encodeState(3, other.state).size());
+  Iono.set(DI1, 1);
+  CHECK(runUntil([&]() {
+    return gateway.states.count(2) > 0 && gateway.states[2].get(DI1) == 1;
+  }, 2000));
+  CHECK(Reports.deferred >= 1);
+  CHECK_EQ(diagnostic("Reports deferred for busy channel"), Reports.deferred);
+  CHECK_EQ(diagnostic("Reports held for duty cycle"), 0);
+
+  // waited for the channel, then one to two slots of backoff
+  CHECK(Reports.delayMax >= busyUs / 1000 - DELAY);
+  CHECK(Reports.delayMax <= busyUs / 1000 + 2 * slot);
+  CHECK_EQ(diagnostic("Max report delay [ms]"), Reports.delayMax);
+
+  return TEST_RESULT();
+}
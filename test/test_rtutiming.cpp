@@ -0,0 +1,139 @@
+/*
+  Modbus RTU requests received while the gateway's radio is sending a
+  command: the bytes are buffered during the transmission and the
+  request is answered as soon as the inter-frame silence after it is
+  over, without waiting for the loop's background work. The bytes fit
+  the serial port's RX buffer as long as the bus is not busy for the
+  whole transmission.
+*/
+
+#include "LoRaBus.cpp"
+#include "Harness.h"
+
+using namespace harness;
+
+const char *CONFIG =
+  "[GATEWAY]\r\n"
+  "Unit address: 1\r\n"
+  "LoRa frequency: 869500\r\n"
+  "LoRa TX power: 14\r\n"
+  "LoRa spreading factor: 7\r\n"
+  "LoRa duty cycle: 10.00\r\n"
+  "LoRa duty cycle window: 3600\r\n"
+  "Site ID: abc\r\n"
+  "Password: 16AsciiCharsPwrd\r\n"
+  "Input modes: DDVI-D\r\n"
+  "I/O rules: ----\r\n"
+  "Serial speed: 115200\r\n"
+  "Serial parity: Even\r\n"
+  "Remote units: 2\r\n";
+
+int main() {
+  CHECK(boot(CONFIG));
+  CHECK_EQ(sim::bus.baud, 115200);
+  sim::Unit unit(2, 869500);
+  unit.report();
+  run(400);
+
+  const unsigned long t35 = 1750;
+  for (int i = 0; i < 20; i++) {
+    int on = (i + 1) % 2;
+    CHECK_EQ(write(2, MB_FC_WRITE_SINGLE_COIL, 1, on), 0);
+    // the command is sent by the next loop
+    CHECK(runUntil([]() { return !slavesBuffer[0].outbox.empty(); }, 2000));
+
+    // a request reaching the UART right after the transmission started
+    std::vector<uint8_t> req = sim::rtuFrame(pdu(2, MB_FC_READ_INPUT_REGISTER, 201, 1));
+    unsigned long responses = sim::bus.responses;
+    unsigned long txFrames = LoRa.radio.txFrames;
+    unsigned long long txUs = LoRa.radio.txUs;
+    unsigned long long txStart = sim::nowUs;
+    sim::bus.send(req);
+    step();
+    CHECK_EQ(LoRa.radio.txFrames, txFrames + 1);
+    unsigned long long txEnd = txStart + (LoRa.radio.txUs - txUs);
+    CHECK(txEnd - txStart > req.size() * sim::bus.byteUs());
+
+    CHECK(runUntil([&]() { return sim::bus.responses != responses; }, 100));
+    unsigned long long responseStart = sim::bus.responseTs - sim::bus.response.size() * sim::bus.byteUs();
+    CHECK(responseStart >= txEnd + t35);
+    CHECK(responseStart <= txEnd + t35 + 2 * sim::loopUs);
+    CHECK_EQ(sim::bus.response[1], MB_FC_READ_INPUT_REGISTER);
+    CHECK(runUntil([&]() { return unit.state.get(DO1) == on; }, 2000));
+    run(1000);
+  }
+
+  // the hourly save of the counters falls in the loop that sends the
+  // command: the request is answered right after the flash write, not
+  // t35 after it
+  const unsigned long long flashUs = ((sizeof(CountersRecord) + 255) / 256) * sim::flashRowUs;
+  CHECK(flashUs > t35);
+  for (int i = 0; i < 3; i++) {
+    unit.state.counts[0] += 1;
+    unit.report();
+    run(1000);
+    CHECK_EQ(read(2, MB_FC_READ_INPUT_REGISTER, 1001), unit.state.counts[0]);
+    run(1000);
+
+    CHECK_EQ(write(2, MB_FC_WRITE_SINGLE_COIL, 1, (i + 1) % 2), 0);
+    CHECK(runUntil([]() { return !slavesBuffer[0].outbox.empty(); }, 2000));
+    sim::advance(COUNTERS_SAVE_PERIOD * 1000000ull);
+
+    std::vector<uint8_t> req = sim::rtuFrame(pdu(2, MB_FC_READ_INPUT_REGISTER, 201, 1));
+    unsigned long responses = sim::bus.responses;
+    unsigned long long txUs = LoRa.radio.txUs;
+    unsigned long long txStart = sim::nowUs;
+    sim::bus.send(req);
+    step();
+    unsigned long long txEnd = txStart + (LoRa.radio.txUs - txUs);
+
+    CHECK(runUntil([&]() { return sim::bus.responses != responses; }, 200));
+    unsigned long long responseStart = sim::bus.responseTs - sim::bus.response.size() * sim::bus.byteUs();
+    CHECK(responseStart >= txEnd + flashUs);
+    CHECK(responseStart < txEnd + flashUs + t35);
+    CHECK_EQ(sim::bus.response[1], MB_FC_READ_INPUT_REGISTER);
+    run(1000);
+  }
+  CHECK_EQ(ModbusRtuSlave.errors, 0);
+
+  // a request of the max length received during the transmission fits
+  // the serial port's RX buffer
+  std::vector<uint8_t> longPdu = {2, MB_FC_WRITE_MULTIPLE_REGISTERS, 0x02, 0x59, 0, 123, 246};
+  longPdu.resize(longPdu.size() + 246, 0);
+  std::vector<uint8_t> longReq = sim::rtuFrame(longPdu);
+  CHECK_EQ(longReq.size(), SIM_UART_RX_SIZE - 1);
+  CHECK_EQ(write(2, MB_FC_WRITE_SINGLE_COIL, 1, 0), 0);
+  CHECK(runUntil([]() { return !slavesBuffer[0].outbox.empty(); }, 2000));
+  unsigned long responses = sim::bus.responses;
+  unsigned long long txUs = LoRa.radio.txUs;
+  sim::bus.send(longReq);
+  step();
+  CHECK(LoRa.radio.txUs - txUs > longReq.size() * sim::bus.byteUs());
+  CHECK(runUntil([&]() { return sim::bus.responses != responses; }, 100));
+  CHECK_EQ(sim::bus.response[0], 2);
+  CHECK_EQ(sim::bus.overruns, 0);
+  CHECK_EQ(ModbusRtuSlave.errors, 0);
+  run(1000);
+
+  // traffic on the bus for the whole time-on-air, e.g. other devices'
+  // requests and responses, overruns the RX buffer: the bytes past it are
+  // lost, the frame is discarded and the next request is answered
+  CHECK_EQ(write(2, MB_FC_WRITE_SINGLE_COIL, 1, 1), 0);
+  CHECK(runUntil([]() { return !slavesBuffer[0].outbox.empty(); }, 2000));
+  unsigned long long txStart = sim::nowUs;
+  txUs = LoRa.radio.txUs;
+  std::vector<uint8_t> other = longReq;
+  other[0] = 9;
+  for (int i = 0; i < 4; i++) {
+    sim::bus.send(other);
+  }
+  step();
+  unsigned long long txEnd = txStart + (LoRa.radio.txUs - txUs);
+  CHECK(sim::bus.toSlave.back().first > txEnd);
+  run(200);
+  CHECK(sim::bus.overruns > 0);
+  CHECK(ModbusRtuSlave.errors > 0);
+  CHECK_EQ(read(2, MB_FC_READ_INPUT_REGISTER, 201), 0);
+
+  return TEST_RESULT();
+}
@@ -0,0 +1,76 @@
+/*
+  Reads of the remote units served from their last state update as soon
+  as it is received, including updates less than 1 second apart, and
+  reads of stale states
+*/
+
+#include "LoRaBus.cpp"
+#include "Harness.h"
+
+using namespace harness;
+
+const char *CONFIG =
+  "[GATEWAY]\r\n"
+  "Unit address: 1\r\n"
+  "LoRa frequency: 869500\r\n"
+  "LoRa TX power: 14\r\n"
+  "LoRa spreading factor: 7\r\n"
+  "LoRa duty cycle: 10.00\r\n"
+  "LoRa duty cycle window: 600\r\n"
+  "Site ID: abc\r\n"
+  "Password: 16AsciiCharsPwrd\r\n"
+  "Input modes: DDVI-D\r\n"
+  "I/O rules: ----\r\n"
+  "Serial speed: 19200\r\n"
+  "Serial parity: Even\r\n"
+  "Remote units: 2, 3, 4, 5, 6, 7, 8, 9\r\n"
+  "Max state age: 5\r\n";
+
+// runs until the gateway receives a frame
+void receive() {
+  unsigned long rx = LoRa.radio.rxFrames;
+  CHECK(runUntil([&]() { return LoRa.radio.rxFrames != rx; }, 1000));
+}
+
+int main() {
+  CHECK(boot(CONFIG));
+  CHECK_EQ(SerialConfig.maxAge, 5);
+  CHECK(console.find("Max state age: 5") != std::string::npos);
+
+  sim::Unit unit(9, 869500);
+  unit.set(AV1, 1);
+  receive();
+  CHECK_EQ(read(9, MB_FC_READ_INPUT_REGISTER, 201), 1000);
+  CHECK_EQ(read(9, MB_FC_READ_INPUT_REGISTER, 5113), 1);
+  run(2000);
+
+  // served as soon as received, with an event for each change
+  word events = read(1, MB_FC_READ_INPUT_REGISTER, 5501);
+  unit.set(DI1, 1);
+  receive();
+  CHECK_EQ(read(9, MB_FC_READ_DISCRETE_INPUTS, 101), 1);
+  run(300);
+  unit.set(DI1, 0);
+  receive();
+  CHECK_EQ(read(9, MB_FC_READ_DISCRETE_INPUTS, 101), 0);
+  run(300);
+  unit.set(DI1, 1);
+  receive();
+  CHECK_EQ(read(9, MB_FC_READ_DISCRETE_INPUTS, 101), 1);
+  run(1000);
+  // the last two updates within 1 second are logged as one, the pulse
+  // as a counter increment
+  CHECK_EQ(read(1, MB_FC_READ_INPUT_REGISTER, 5501), events + 2);
+  CHECK_EQ(read(9, MB_FC_READ_INPUT_REGISTER, 5113), 3);
+  CHECK_EQ(read(9, MB_FC_READ_INPUT_REGISTER, 1001), 2);
+
+  // older than the max state age
+  run(5000);
+  CHECK_EQ(read(9, MB_FC_READ_DISCRETE_INPUTS, 101), -MB_EX_SLAVE_DEVICE_FAILURE);
+  CHECK_EQ(read(9, MB_FC_READ_INPUT_REGISTER, 201), -MB_EX_SLAVE_DEVICE_FAILURE);
+  unit.report();
+  receive();
+  CHECK_EQ(read(9, MB_FC_READ_DISCRETE_INPUTS, 101), 1);
+
+  return TEST_RESULT();
+}
@@ -0,0 +1,69 @@
+/*
+  Configuration wizard of a remote unit: entries out of range are asked
+  again, also when their digits exceed the stored type
+*/
+
+#include "LoRaBus.cpp"
+#include "Harness.h"
+
+using namespace harness;
+
+// one answer per line, as typed
+const char *ANSWERS[] = {
+  "1",                  // configuration wizard
+  "2",                  // remote unit
+  "2",                  // address
+  "869500",             // frequency
+  "0",                  // no channels list
+  "14",                 // TX power
+  "7",                  // spreading factor
+  "10",                 // duty cycle
+  "600",                // duty cycle window
+  "abc",                // site ID
+  "16AsciiCharsPwrd",   // password
+  "V-----",             // input modes
+  "----",               // I/O rules
+  "5",                  // input 1 updates interval
+  "70000",              // input 1 deadband, above the limit
+  "0",                  // below the limit
+  "250",
+  "0",                  // heartbeat period
+  "0",                  // aggregation delay
+  "0",                  // receive windows period
+  "Y",
+};
+
+int countOf(const std::string &s, const std::string &sub) {
+  int n = 0;
+  for (size_t p = s.find(sub); p != std::string::npos; p = s.find(sub, p + 1)) {
+    n++;
+  }
+  return n;
+}
+
+int main() {
+  std::string typed;
+  for (const char *a : ANSWERS) {
+    typed += std::string(a) + "\r";
+  }
+  Serial.input("     ");
+  Serial.input(typed.c_str(), 200);
+  try {
+    setup();
+  } catch (sim::Reset &) {
+  }
+  std::string output = Serial.output;
+  Serial.clear();
+  start();
+
+  CHECK(SerialConfig.isConfigured);
+  CHECK(!SerialConfig.isGateway);
+  CHECK_EQ(SerialConfig.address, 2);
+  CHECK_EQ(SerialConfig.dc, 100);
+  CHECK(strcmp(SerialConfig.modes, "V-----") == 0);
+  CHECK_EQ(SerialConfig.inItvl[0], 5);
+  CHECK_EQ(SerialConfig.inDb[0], 250);
+  CHECK_EQ(countOf(output, "Input 1 [current: "), 1 + 3);
+
+  return TEST_RESULT();
+}